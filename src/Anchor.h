@@ -11,60 +11,75 @@
 #ifndef ANCHOR_H
 #define ANCHOR_H
 
-class Anchor {
+#include <stdint.h>
+
+/// BasicAnchor - A run of tokens common to the source and the target. Index 
+/// is the integer type of token offsets; see BasicSuffixArray.
+template <typename Index>
+class BasicAnchor {
   /// Index marking the start of this Anchor in the source.
-  int source;
+  Index source;
 
   /// Index marking the start of this Anchor in the target.
-  int target;
+  Index target;
   
   /// Number of tokens identified in the run.
-  int len;
+  Index len;
 public:
   /// Anchor constructor - Create a new Anchor object.
-  Anchor(int idx0, int idx1, int len) 
+  BasicAnchor(Index idx0, Index idx1, Index len) 
     : source(idx0), target(idx1), len(len) {
   }
 
-  bool operator==(const Anchor &rhs) const { 
+  bool operator==(const BasicAnchor &rhs) const { 
     return (len == rhs.len && source == rhs.source && target == rhs.target);
   }
   
-  bool operator<(const Anchor &rhs) const { return len < rhs.len; }
-  bool operator<=(const Anchor &rhs) const { return len <= rhs.len; }
-  bool operator!=(const Anchor &rhs) const { return !(*this == rhs); }
-  bool operator>(const Anchor &rhs) const { return rhs < *this; }
-  bool operator>=(const Anchor &rhs) const { return rhs <= *this; }
+  bool operator<(const BasicAnchor &rhs) const { return len < rhs.len; }
+  bool operator<=(const BasicAnchor &rhs) const { return len <= rhs.len; }
+  bool operator!=(const BasicAnchor &rhs) const { return !(*this == rhs); }
+  bool operator>(const BasicAnchor &rhs) const { return rhs < *this; }
+  bool operator>=(const BasicAnchor &rhs) const { return rhs <= *this; }
 
   /// sourceIdx - Returns the index designating the start of this Anchor 
   ///             in the source token datastream.
-  int sourceIdx() const { return source; }
+  Index sourceIdx() const { return source; }
 
   /// targetIdx - Returns the index designating the start of this Anchor 
   ///             in the target token datastream.
-  int targetIdx() const { return target; }
+  Index targetIdx() const { return target; }
 
   /// sourceIdxEnd - Returns the index designating the end of this Anchor 
   ///                in the source token datastream.
-  int sourceIdxEnd() const { return source + len; }
+  Index sourceIdxEnd() const { return source + len; }
 
   /// targetIdxEnd - Returns the index designating the end of this Anchor 
   ///                in the target token datastream.
-  int targetIdxEnd() const { return target + len; }
+  Index targetIdxEnd() const { return target + len; }
 
   /// length - Returns the number of tokens identified in this Anchor.
-  int length() const { return len; } 
+  Index length() const { return len; } 
 };
 
+/// Anchor - The default, 32-bit anchor.
+typedef BasicAnchor<int> Anchor;
+
+/// Anchor64 - An anchor into token streams of more than 2^31 tokens.
+typedef BasicAnchor<int64_t> Anchor64;
+
 /// compareSourceIndex - Returns true if the sequence identified by a1 occurs
 /// before the sequence identified by a2 in the source token stream.
-static bool compareSourceIndex(const Anchor &a1, const Anchor &a2) {
+template <typename Index>
+static bool compareSourceIndex(const BasicAnchor<Index> &a1, 
+                               const BasicAnchor<Index> &a2) {
   return (a1.sourceIdx() < a2.sourceIdx());
 }
   
 /// compareTargetIndex - Returns true if the sequence identified by a1 occurs
 /// before the sequence identified by a2 in the target token stream
-static bool compareTargetIndex(const Anchor &a1, const Anchor &a2) {
+template <typename Index>
+static bool compareTargetIndex(const BasicAnchor<Index> &a1, 
+                               const BasicAnchor<Index> &a2) {
   return (a1.targetIdx() < a2.targetIdx());
 }
 
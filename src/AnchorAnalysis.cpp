@@ -10,73 +10,823 @@
 
 #include "Anchor.h"
 #include "AnchorAnalysis.h"
+#include "AnchorSet.h"
+#include "ExternalSort.h"
+#include "ExternalSuffixArray.h"
+#include "Parallel.h"
+#include "ReferenceIndex.h"
 #include "SuffixArray.h"
 #include "Token.h"
+#include "TokenText.h"
 
 #include <algorithm>
+#include <deque>
+#include <functional>
+#include <limits>
 
-std::vector<Anchor> AnchorAnalysis::findAnchors(
-    const std::vector<Token> sourceTokenStream,
-    const std::vector<Token> targetTokenStream) {
+/// RangeMinimum - Answers minimum queries over ranges of an array in 
+/// constant time. A range within one block is scanned; any other is covered
+/// by the end of its first block, the start of its last one, and the blocks
+/// in between, whose minimum two overlapping entries of a sparse table over
+/// the block minima give.
+template <typename Index>
+class RangeMinimum {
+  static const Index BlockSize = 64;
+  const std::vector<Index> &values;
 
-  const int sourceTokenStreamSize = sourceTokenStream.size();
-  const int targetTokenStreamSize = targetTokenStream.size();
+  /// The smallest values from the start of each block up to every position,
+  /// and from every position to the end of its block.
+  std::vector<Index> prefixMinima, suffixMinima;
 
-  SuffixArray sa(sourceTokenStream, targetTokenStream);
-  std::vector<int> indexPoints = sa.orderedIndexPoints();
-  std::vector<int> LCPs        = sa.LCPs();
-  std::vector<int> orderedLCPs = sa.orderedLCPs();
+  /// levels[j][b] - The smallest of the values in blocks b to b + 2^j - 1.
+  std::vector<std::vector<Index> > levels;
+public:
+  explicit RangeMinimum(const std::vector<Index> &v) 
+    : values(v), prefixMinima(v), suffixMinima(v), levels(1) {
+    const Index n = values.size();
+    for (Index i = 0; i < n; i += BlockSize) {
+      const Index e = std::min(n, i + BlockSize);
+      for (Index j = i + 1; j < e; ++j)
+        prefixMinima[j] = std::min(prefixMinima[j - 1], values[j]);
+      for (Index j = e - 2; j >= i; --j)
+        suffixMinima[j] = std::min(suffixMinima[j + 1], values[j]);
+      levels[0].push_back(prefixMinima[e - 1]);
+    }
+    const Index blocks = levels[0].size();
+    for (Index width = 1; 2 * width <= blocks; width *= 2) {
+      const std::vector<Index> &below = levels.back();
+      std::vector<Index> level(blocks - 2 * width + 1);
+      for (Index b = 0, e = level.size(); b < e; ++b)
+        level[b] = std::min(below[b], below[b + width]);
+      levels.push_back(level);
+    }
+  }
+
+  /// query - Returns the smallest of values[first..last].
+  Index query(Index first, Index last) const {
+    const Index firstBlock = first / BlockSize, lastBlock = last / BlockSize;
+    if (firstBlock == lastBlock)
+      return *std::min_element(values.begin() + first, 
+                               values.begin() + last + 1);
+    Index m = std::min(suffixMinima[first], prefixMinima[last]);
+    if (firstBlock + 1 < lastBlock) {
+      const Index blocks = lastBlock - firstBlock - 1;
+      Index j = 0;
+      while ((Index)2 << j <= blocks)
+        ++j;
+      m = std::min(m, std::min(levels[j][firstBlock + 1], 
+                               levels[j][lastBlock - ((Index)1 << j)]));
+    }
+    return m;
+  }
+};
+
+/// restrictToRanks - Store the suffixes at the given ascending ranks of a 
+/// suffix array in subIndexPoints, moved down by offset, and the LCPs 
+/// between each of them and the one before in subLCPs.
+template <typename Index>
+static void restrictToRanks(const std::vector<Index> &ranks, 
+                            const std::vector<Index> &indexPoints,
+                            const RangeMinimum<Index> &rmq, Index offset,
+                            std::vector<Index> &subIndexPoints, 
+                            std::vector<Index> &subLCPs) {
+  subIndexPoints.resize(ranks.size());
+  subLCPs.assign(ranks.size(), 0);
+  for (Index i = 0, e = ranks.size(); i < e; ++i) {
+    subIndexPoints[i] = indexPoints[ranks[i]] - offset;
+    if (i > 0)
+      subLCPs[i] = rmq.query(ranks[i - 1] + 1, ranks[i]);
+  }
+}
+
+/// pruneUniqueTokens - Append the ids of tokenStream to text, keeping only 
+/// the first of every run of tokens that occur once in both streams 
+/// together, and the position each kept id had in tokenStream to origins.
+template <typename Index>
+static void pruneUniqueTokens(TokenRange tokenStream,
+                              const std::vector<unsigned char> &occurrences,
+                              std::vector<Index> &text, 
+                              std::vector<Index> &origins) {
+  bool inRun = false;
+  for (Index i = 0, e = tokenStream.size(); i < e; ++i) {
+    const int id = tokenStream[i].getHashValue();
+    const bool unique = occurrences[id] == 1;
+    if (!unique || !inRun) {
+      text.push_back(id);
+      origins.push_back(i);
+    }
+    inRun = unique;
+  }
+}
+
+/// MaxSubstitutions, MinExtension - An anchor is carried on past at most 
+/// this many mismatching tokens in either stream, by a match of at least 
+/// MinExtension tokens behind them or one that reaches the next anchor.
+static const int MaxSubstitutions = 2;
+static const int MinExtension = 2;
+
+/// MinFuzzySeed - The fewest tokens two neighbouring suffixes must share to
+/// seed an anchor with mismatches.
+static const int MinFuzzySeed = 4;
+
+/// LongestCommonExtension - Answers how many tokens of a suffix array text 
+/// match from two positions on in constant time: the smallest LCP between 
+/// the ranks of the suffixes starting there.
+template <typename Index>
+class LongestCommonExtension {
+  std::vector<Index> ranks;
+  RangeMinimum<Index> rmq;
+public:
+  LongestCommonExtension(const std::vector<Index> &indexPoints,
+                         const std::vector<Index> &LCPs)
+    : ranks(indexPoints.size()), rmq(LCPs) {
+    for (Index r = 0, n = indexPoints.size(); r < n; ++r)
+      ranks[indexPoints[r]] = r;
+  }
+
+  /// rank - Returns the rank of the suffix at x.
+  Index rank(Index x) const { return ranks[x]; }
+
+  /// query - Returns the length of the common prefix of the suffixes at x 
+  /// and y, which must differ.
+  Index query(Index x, Index y) const {
+    return rmq.query(std::min(ranks[x], ranks[y]) + 1, 
+                     std::max(ranks[x], ranks[y]));
+  }
+};
 
-  std::vector<Anchor> crossAnchors, sourceAnchors, targetAnchors;
+/// extendAnchors - Carry each of the aligned anchors between two token 
+/// streams, a run of equal tokens ending at the first mismatch, on along its
+/// diagonal past a few substituted tokens, as long as the tokens behind them
+/// match, and merge it with the next anchor if it runs into it. Each of the
+/// small gaps this leaves is a plain substitution. The tokens are compared 
+/// directly; an extension never reaches past the next anchor, so every 
+/// token is compared a bounded number of times.
+template <typename Index>
+static void extendAnchors(std::vector<BasicAnchor<Index> > &anchors,
+                          TokenRange sourceTokenStream,
+                          TokenRange targetTokenStream) {
+  typedef BasicAnchor<Index> Anchor;
+  const Index sourceSize = sourceTokenStream.size(), 
+              targetSize = targetTokenStream.size();
+  std::vector<Anchor> extended;
+  extended.reserve(anchors.size());
+  for (size_t i = 0, e = anchors.size(); i < e; ++i) {
+    const Index sourceEnd = (i + 1 < e) ? anchors[i + 1].sourceIdx() : sourceSize;
+    const Index targetEnd = (i + 1 < e) ? anchors[i + 1].targetIdx() : targetSize;
+    Anchor anch = anchors[i];
+    for (;;) {
+      // Skip the fewest tokens after which the streams match again. They 
+      // must be as many in either stream.
+      const Index x = anch.sourceIdxEnd(), y = anch.targetIdxEnd();
+      Index d = 1, len = 0;
+      for (; d <= MaxSubstitutions && x + d < sourceEnd && y + d < targetEnd;
+           ++d) {
+        while (x + d + len < sourceEnd && y + d + len < targetEnd &&
+               sourceTokenStream[x + d + len] == 
+               targetTokenStream[y + d + len])
+          ++len;
+        if (len > 0)
+          break;
+      }
+      const bool meets = x + d + len == sourceEnd && y + d + len == targetEnd;
+      if (len == 0 || (len < MinExtension && !meets))
+        break;
+      extended.push_back(anch);
+      anch = Anchor(x + d, y + d, len);
+    }
+    if (i + 1 < e && anch.sourceIdxEnd() == sourceEnd && 
+        anch.targetIdxEnd() == targetEnd)
+      anchors[i + 1] = Anchor(anch.sourceIdx(), anch.targetIdx(), 
+                              anch.length() + anchors[i + 1].length());
+    else
+      extended.push_back(anch);
+  }
+  anchors.swap(extended);
+}
+
+/// findFuzzyMatches - Return the maximal matches between the source and 
+/// target of a suffix array text that may hold up to maxMismatches 
+/// substituted tokens, longest first and overlapping none that comes 
+/// before. Every pair of neighbouring suffixes from either stream that share
+/// MinFuzzySeed tokens seeds a match; it is extended to the left over equal
+/// tokens and to the right by longest common extensions, past runs of at 
+/// most MaxSubstitutions substituted tokens followed by at least 
+/// MinExtension matching ones. As in discardConfusingAnchorsI, only matches
+/// with at least as many matching tokens as the longest self anchor are 
+/// kept.
+template <typename Index>
+static std::vector<BasicAnchor<Index> > findFuzzyMatches(
+    const std::vector<Index> &indexPoints, const std::vector<Index> &LCPs,
+    const LongestCommonExtension<Index> &lce,
+    TokenRange sourceTokenStream,
+    TokenRange targetTokenStream,
+    const std::vector<Index> &sourceOrigins,
+    const std::vector<Index> &targetOrigins, Index maxMismatches) {
+  typedef BasicAnchor<Index> Anchor;
+  const Index sourceSize = sourceOrigins.size(), targetStart = sourceSize + 1,
+              targetSize = targetOrigins.size();
 
-  std::vector<int>::reverse_iterator 
-    i(orderedLCPs.rbegin()), e(orderedLCPs.rend());
+  // The longest self anchor is the longest LCP of two neighbours from the 
+  // same stream; the seeds are the neighbours from different ones.
+  Index thresh = 0;
+  std::vector<Anchor> seeds;
+  for (Index r = 1, n = indexPoints.size(); r < n; ++r) {
+    const Index x = indexPoints[r], y = indexPoints[r - 1];
+    if ((x < sourceSize) == (y < sourceSize))
+      thresh = std::max(thresh, LCPs[r]);
+    else if (LCPs[r] >= MinFuzzySeed)
+      seeds.push_back(x < sourceSize ? Anchor(x, y - targetStart, LCPs[r]) :
+                                       Anchor(y, x - targetStart, LCPs[r]));
+  }
+  auto byDiagonal = [](const Anchor &a, const Anchor &b) {
+    const Index da = a.targetIdx() - a.sourceIdx(), 
+                db = b.targetIdx() - b.sourceIdx();
+    return da < db || (da == db && a.sourceIdx() < b.sourceIdx());
+  };
+  std::sort(seeds.begin(), seeds.end(), byDiagonal);
+
+  // Extend the first seed of every run along a diagonal; the seeds its 
+  // match covers are skipped.
+  std::vector<Anchor> matches;
+  Index diagonal = 0, covered = -1;
+  typename std::vector<Anchor>::const_iterator i(seeds.begin()), 
+                                               e(seeds.end());
   for (; i != e; ++i) {
-    const int LCP = *i;
-    const int idx = distance(LCPs.begin(), find(LCPs.begin(), LCPs.end(), LCP));
-    const int x = indexPoints[idx];
-    const int y = indexPoints[idx - 1];
-    const int len = LCPs[idx];
-
-    // First check for self-anchors. Self-anchors represent the common 
-    // substrings found when considering a file with itself. They give us a 
-    // way to express self similarity by providing a measure on the 
-    // distribution of common substrings for that file. By getting an idea of 
-    // how similar two files are with themselves, we can get a better feel for 
-    // the statistical significance of common substrings between two files to
-    // later set some threshold level.
-    //
-    // We say an anchor is a self anchor from the source stream when both
-    // indexes x and y are found in the source stream.
-    //
-    // We say an anchor is a self anchor from the target stream when both
-    // indexes x and y are found in the target stream.
-    if ((x < sourceTokenStreamSize) && (y < sourceTokenStreamSize)) {
-      Anchor srcAnch(x, y, len);
-      if (isMaximal(srcAnch, sourceAnchors)) 
-        sourceAnchors.push_back(srcAnch);
-    } else if ((sourceTokenStreamSize < x) && (sourceTokenStreamSize < y)) {
-      Anchor tgtAnch(x - sourceTokenStreamSize - 1, y - sourceTokenStreamSize - 1, len);
-      if (isMaximal(tgtAnch, targetAnchors)) 
-        targetAnchors.push_back(tgtAnch);
-    } else {
-      // Check for a maximal cross anchor. Cross anchors represent common 
-      // substrings between two files. We need to consider two cases here:
-      //  1) When x is in the source stream and y is in the target stream
-      //  2) When y is in the source stream and x is in the target stream
-      if ((x < sourceTokenStreamSize) && (sourceTokenStreamSize < y)) {
-        Anchor anch(x, y - sourceTokenStreamSize - 1, len);
-        if (isMaximal(anch, crossAnchors))
-          crossAnchors.push_back(anch);
+    if (i->targetIdx() - i->sourceIdx() == diagonal && i->sourceIdx() < covered)
+      continue;
+    Index x = i->sourceIdx(), y = i->targetIdx();
+    while (x > 0 && y > 0 && sourceTokenStream[sourceOrigins[x - 1]] == 
+                             targetTokenStream[targetOrigins[y - 1]]) {
+      --x;
+      --y;
+    }
+    Index span = lce.query(x, targetStart + y), matched = span, mismatches = 0;
+    for (;;) {
+      Index d = 1, len = 0;
+      for (; d <= MaxSubstitutions && mismatches + d <= maxMismatches &&
+             x + span + d < sourceSize && y + span + d < targetSize &&
+             sourceOrigins[x + span + d] - sourceOrigins[x + span] == d &&
+             targetOrigins[y + span + d] - targetOrigins[y + span] == d; ++d) {
+        len = lce.query(x + span + d, targetStart + y + span + d);
+        if (len > 0)
+          break;
       }
-      else if ((y < sourceTokenStreamSize) && (sourceTokenStreamSize < x)) {
-        Anchor anch(y, x - sourceTokenStreamSize - 1, len);
-        if (isMaximal(anch, crossAnchors))
-          crossAnchors.push_back(anch);
+      if (len < MinExtension)
+        break;
+      span += d + len;
+      matched += len;
+      mismatches += d;
+    }
+    diagonal = y - x;
+    covered = x + span;
+    if (matched >= thresh)
+      matches.push_back(Anchor(x, y, span));
+  }
+  std::vector<Anchor>().swap(seeds);
+
+  std::stable_sort(matches.begin(), matches.end(), std::greater<Anchor>());
+  AnchorSet<Index> maximalMatches;
+  for (size_t m = 0; m < matches.size(); ++m)
+    maximalMatches.insert(matches[m]);
+  return maximalMatches.anchors();
+}
+
+/// splitFuzzyMatches - Replace every match with mismatches by the runs of 
+/// matching tokens it consists of, leaving the mismatches as gaps between 
+/// anchors.
+template <typename Index>
+static void splitFuzzyMatches(std::vector<BasicAnchor<Index> > &matches,
+                              const LongestCommonExtension<Index> &lce,
+                              Index targetStart) {
+  typedef BasicAnchor<Index> Anchor;
+  std::vector<Anchor> anchors;
+  for (size_t i = 0; i < matches.size(); ++i) {
+    const Index x = matches[i].sourceIdx(), y = matches[i].targetIdx();
+    for (Index p = 0, span = matches[i].length(); p < span;) {
+      const Index len = std::min(lce.query(x + p, targetStart + y + p), 
+                                 span - p);
+      if (len > 0)
+        anchors.push_back(Anchor(x + p, y + p, len));
+      p += std::max(len, (Index)1);
+    }
+  }
+  matches.swap(anchors);
+}
+
+template <typename Index>
+std::vector<BasicAnchor<Index> > BasicAnchorAnalysis<Index>::findAnchors(
+    TokenRange sourceTokenStream,
+    TokenRange targetTokenStream) {
+  // A token that occurs once in both streams together is part of no repeat,
+  // and no suffix shares it with another, so comparisons of suffixes stop 
+  // there. The rest of a run of such tokens is never compared and only adds
+  // suffixes that share nothing; leave it out of the suffix array. The order
+  // and LCPs of the other suffixes stay as they were, and so do the anchors.
+  int maxId = 1;
+  for (size_t i = 0; i < sourceTokenStream.size(); ++i)
+    maxId = std::max(maxId, sourceTokenStream[i].getHashValue());
+  for (size_t i = 0; i < targetTokenStream.size(); ++i)
+    maxId = std::max(maxId, targetTokenStream[i].getHashValue());
+  std::vector<unsigned char> occurrences(maxId + 1, 0);
+  for (size_t i = 0; i < sourceTokenStream.size(); ++i)
+    if (occurrences[sourceTokenStream[i].getHashValue()] < 2)
+      ++occurrences[sourceTokenStream[i].getHashValue()];
+  for (size_t i = 0; i < targetTokenStream.size(); ++i)
+    if (occurrences[targetTokenStream[i].getHashValue()] < 2)
+      ++occurrences[targetTokenStream[i].getHashValue()];
+
+  std::vector<Index> text, sourceOrigins, targetOrigins;
+  text.reserve(sourceTokenStream.size() + targetTokenStream.size() + 5);
+  pruneUniqueTokens(sourceTokenStream, occurrences, text, sourceOrigins);
+  text.push_back(0);
+  pruneUniqueTokens(targetTokenStream, occurrences, text, targetOrigins);
+  text.push_back(1);
+  std::vector<unsigned char>().swap(occurrences);
+
+  const Index sourceSize = sourceOrigins.size();
+  const size_t firstUnaligned = unalignedAnchors ? unalignedAnchors->size() : 0;
+  std::vector<Anchor> anchors;
+  {
+    const BasicSuffixArray<Index> sa(text, construction);
+    std::vector<Index>().swap(text);
+    const LongestCommonExtension<Index> lce(sa.orderedIndexPoints(), 
+                                            sa.LCPs());
+    if (maxMismatches > 0) {
+      anchors = findFuzzyMatches(sa.orderedIndexPoints(), sa.LCPs(), lce, 
+                                 sourceTokenStream, targetTokenStream, 
+                                 sourceOrigins, targetOrigins, maxMismatches);
+      alignCrossAnchors(anchors);
+      splitFuzzyMatches(anchors, lce, sourceSize + 1);
+
+      // Only the tokens a match has in common moved; its mismatches are 
+      // edits, so a match left unaligned is split as well.
+      if (unalignedAnchors) {
+        std::vector<Anchor> unaligned(
+            unalignedAnchors->begin() + firstUnaligned, 
+            unalignedAnchors->end());
+        splitFuzzyMatches(unaligned, lce, sourceSize + 1);
+        unalignedAnchors->erase(unalignedAnchors->begin() + firstUnaligned,
+                                unalignedAnchors->end());
+        unalignedAnchors->insert(unalignedAnchors->end(), unaligned.begin(),
+                                 unaligned.end());
       }
+    } else {
+      anchors = classifyAnchors(sa.orderedIndexPoints(), sa.LCPs(), 
+                                sourceSize, sourceSize + 1);
+    }
+  }
+
+  // No anchor spans a pruned token, so each one starts where its first 
+  // token was.
+  for (size_t i = 0; i < anchors.size(); ++i)
+    anchors[i] = Anchor(sourceOrigins[anchors[i].sourceIdx()], 
+                        targetOrigins[anchors[i].targetIdx()], 
+                        anchors[i].length());
+  extendAnchors(anchors, sourceTokenStream, targetTokenStream);
+  if (unalignedAnchors)
+    for (size_t i = firstUnaligned; i < unalignedAnchors->size(); ++i) {
+      Anchor &anch = (*unalignedAnchors)[i];
+      anch = Anchor(sourceOrigins[anch.sourceIdx()], 
+                    targetOrigins[anch.targetIdx()], anch.length());
     }
-    // Invalidate the current LCP entry.
-		LCPs[idx] = -1;
+  return anchors;
+}
+
+template <typename Index>
+std::vector<std::vector<BasicAnchor<Index> > > 
+BasicAnchorAnalysis<Index>::findAnchors(
+    TokenRange sourceTokenStream,
+    const std::vector<TokenRange> &targetTokenStreams) {
+  std::vector<TokenRange> tokenStreams;
+  tokenStreams.push_back(sourceTokenStream);
+  tokenStreams.insert(tokenStreams.end(), targetTokenStreams.begin(), 
+                      targetTokenStreams.end());
+  const BasicSuffixArray<Index> sa(tokenStreams, construction);
+  const std::vector<Index> &indexPoints = sa.orderedIndexPoints();
+  const std::vector<Index> &LCPs = sa.LCPs();
+
+  // Stream k starts at starts[k] and is followed by its sentinel.
+  const Index nStreams = tokenStreams.size();
+  std::vector<Index> starts(nStreams + 1, 0);
+  for (Index k = 0; k < nStreams; ++k)
+    starts[k + 1] = starts[k] + tokenStreams[k].size() + 1;
+
+  // Split the suffix array into the ranks of each stream's suffixes in a 
+  // single pass. Sentinel suffixes share nothing with their neighbours and
+  // are left out.
+  std::vector<std::vector<Index> > ranks(nStreams);
+  for (Index r = 0, e = indexPoints.size(); r < e; ++r) {
+    const Index x = indexPoints[r];
+    const Index k = std::upper_bound(starts.begin(), starts.end(), x) - 
+                    starts.begin() - 1;
+    if (x + 1 != starts[k + 1])
+      ranks[k].push_back(r);
+  }
+
+  // The suffixes of the source and one target, in the order they have in 
+  // the generalized suffix array, are exactly the suffix array of the two 
+  // streams alone: sentinel 0 sorts below every other sentinel just as it 
+  // does below sentinel 1. The LCP of two of them is the smallest LCP 
+  // between their ranks. Each pair is classified like the suffix array of 
+  // that pair, one target per thread.
+  const RangeMinimum<Index> rmq(LCPs);
+  const std::vector<Index> &sourceRanks = ranks[0];
+  std::vector<std::vector<Anchor> > result(targetTokenStreams.size());
+  parallelFor(result.size(), 0, [&](size_t t) {
+    const std::vector<Index> &targetRanks = ranks[t + 1];
+    std::vector<Index> pairRanks(sourceRanks.size() + targetRanks.size());
+    std::merge(sourceRanks.begin(), sourceRanks.end(), 
+               targetRanks.begin(), targetRanks.end(), pairRanks.begin());
+
+    std::vector<Index> pairIndexPoints, pairLCPs;
+    restrictToRanks(pairRanks, indexPoints, rmq, (Index)0, 
+                    pairIndexPoints, pairLCPs);
+    result[t] = classifyAnchors(pairIndexPoints, pairLCPs, 
+                                sourceTokenStream.size(), starts[t + 1]);
+    extendAnchors(result[t], sourceTokenStream, targetTokenStreams[t]);
+  });
+  return result;
+}
+
+template <typename Index>
+std::vector<std::vector<BasicAnchor<Index> > > 
+BasicAnchorAnalysis<Index>::findBatchAnchors(
+    const std::vector<TokenRange> &tokenStreams) {
+  const BasicSuffixArray<Index> sa(tokenStreams, construction);
+  const std::vector<Index> &indexPoints = sa.orderedIndexPoints();
+  const std::vector<Index> &LCPs = sa.LCPs();
+
+  const Index nStreams = tokenStreams.size();
+  std::vector<Index> starts(nStreams + 1, 0);
+  for (Index k = 0; k < nStreams; ++k)
+    starts[k + 1] = starts[k] + tokenStreams[k].size() + 1;
+
+  // Split the suffix array into the ranks of each pair's suffixes. Every 
+  // pair has sentinels of its own, so no LCP reaches from one pair into 
+  // another, and the ranks of a pair, with the LCPs between them, make up 
+  // the suffix array of that pair alone: the suffix array findAnchors 
+  // would build, with its positions moved by where the pair starts.
+  std::vector<std::vector<Index> > ranks(nStreams / 2);
+  for (Index r = 0, e = indexPoints.size(); r < e; ++r) {
+    const Index x = indexPoints[r];
+    const Index k = std::upper_bound(starts.begin(), starts.end(), x) - 
+                    starts.begin() - 1;
+    if (x + 1 != starts[k + 1])
+      ranks[k / 2].push_back(r);
+  }
+
+  const RangeMinimum<Index> rmq(LCPs);
+  std::vector<std::vector<Anchor> > result(ranks.size());
+  parallelFor(result.size(), 0, [&](size_t p) {
+    std::vector<Index> pairIndexPoints, pairLCPs;
+    restrictToRanks(ranks[p], indexPoints, rmq, starts[2 * p], 
+                    pairIndexPoints, pairLCPs);
+    std::vector<Index>().swap(ranks[p]);
+    const Index sourceSize = tokenStreams[2 * p].size();
+    result[p] = classifyAnchors(pairIndexPoints, pairLCPs, sourceSize, 
+                                sourceSize + 1);
+    extendAnchors(result[p], tokenStreams[2 * p], tokenStreams[2 * p + 1]);
+  });
+  return result;
+}
+
+namespace {
+
+/// Candidate - A pair of neighbouring suffixes, by the rank of the second.
+template <typename Index>
+struct Candidate {
+  Index len, rank, x, y;
+
+  /// longestFirst - Orders candidates like the LCPs in findAnchors.
+  static bool longestFirst(const Candidate &a, const Candidate &b) {
+    return a.len > b.len || (a.len == b.len && a.rank < b.rank);
+  }
+};
+
+} // end anonymous namespace
+
+template <typename Index>
+bool BasicAnchorAnalysis<Index>::findAnchors(
+    TokenRange sourceTokenStream,
+    TokenRange targetTokenStream,
+    BasicExternalSuffixArray<Index> &sa,
+    std::vector<Anchor> &crossAnchors) {
+  if (!sa.init(sourceTokenStream, targetTokenStream))
+    return false;
+
+  // Write out the neighbours worth an anchor and sort them longest first.
+  TempFile candidates(sa.directory(), sa.statistics()),
+           sorted(sa.directory(), sa.statistics());
+  {
+    TempFile::Reader<Index> indexPoints(sa.orderedIndexPoints()), 
+                            LCPs(sa.LCPs());
+    Index x, y = 0, len;
+    for (Index r = 0; indexPoints.next(x) && LCPs.next(len); ++r) {
+      if (r > 0 && len > 1) {
+        const Candidate<Index> candidate = { len, r, x, y };
+        candidates.append(candidate);
+      }
+      y = x;
+    }
+  }
+  if (!externalSort<Candidate<Index> >(candidates, sorted, sa.memory(), 
+                                       Candidate<Index>::longestFirst))
+    return false;
+
+  const Index sourceTokenStreamSize = sourceTokenStream.size();
+  AnchorSet<Index> sourceAnchors, targetAnchors, maximalCrossAnchors;
+  TempFile::Reader<Candidate<Index> > reader(sorted);
+  Candidate<Index> c;
+  while (reader.next(c))
+    classifyAnchor(Anchor(c.x, c.y, c.len), sourceTokenStreamSize, 
+                   sourceTokenStreamSize + 1, 
+                   sourceAnchors, targetAnchors, maximalCrossAnchors);
+  crossAnchors.swap(maximalCrossAnchors.anchors());
+  discardConfusingAnchors(sourceAnchors.anchors(), targetAnchors.anchors(), 
+                          crossAnchors);
+  extendAnchors(crossAnchors, sourceTokenStream, targetTokenStream);
+  return true;
+}
+
+/// MaxSeedOccurrences - Minimizers that occur more often than this in the
+/// two streams together are too repetitive to seed anchors with.
+static const int MaxSeedOccurrences = 8;
+
+namespace {
+
+/// Minimizer - A k-mer picked as the minimizer of some window, by the hash 
+/// of its tokens and its position in the TokenText.
+template <typename Index>
+struct Minimizer {
+  uint64_t hash;
+  Index pos;
+
+  bool operator<(const Minimizer &rhs) const {
+    return hash < rhs.hash || (hash == rhs.hash && pos < rhs.pos);
+  }
+};
+
+/// Seed - Two positions in the TokenText that start the same minimizer.
+template <typename Index>
+struct Seed {
+  Index x, y;
+
+  /// byDiagonal - Orders seeds by diagonal, and along it by position.
+  static bool byDiagonal(const Seed &a, const Seed &b) {
+    const Index da = a.y - a.x, db = b.y - b.x;
+    return da < db || (da == db && a.x < b.x);
+  }
+};
+
+} // end anonymous namespace
+
+/// scramble - The finalizer of SplitMix64. Minimizers by raw polynomial 
+/// hashes would favour k-mers of small token ids.
+static inline uint64_t scramble(uint64_t h) {
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+/// sampleMinimizers - Append the (w,k)-minimizers of text[first..last-1] to
+/// minimizers: of every w consecutive k-mers, the one with the smallest 
+/// hash, the leftmost of equal ones. A range of fewer than w k-mers gets 
+/// the minimizer of all of them.
+template <typename Index, typename Text>
+static void sampleMinimizers(const Text &text, Index first, Index last, 
+                             Index k, Index w, 
+                             std::vector<Minimizer<Index> > &minimizers) {
+  static const uint64_t Base = 0x100000001b3ULL;
+  if (last - first < k)
+    return;
+  uint64_t power = 1;
+  for (Index i = 1; i < k; ++i)
+    power *= Base;
+
+  // The window holds candidates with increasing hashes, left to right.
+  std::deque<Minimizer<Index> > window;
+  uint64_t h = 0;
+  Index picked = -1;
+  for (Index p = first; p < last; ++p) {
+    if (p - first >= k)
+      h -= power * (uint64_t)text[p - k];
+    h = h * Base + (uint64_t)text[p];
+    const Index start = p - k + 1;
+    if (start < first)
+      continue;
+
+    const Minimizer<Index> m = { scramble(h), start };
+    while (!window.empty() && m.hash < window.back().hash)
+      window.pop_back();
+    window.push_back(m);
+    while (window.front().pos <= start - w)
+      window.pop_front();
+    if ((start - first + 1 >= w || p + 1 == last) && 
+        window.front().pos != picked) {
+      picked = window.front().pos;
+      minimizers.push_back(window.front());
+    }
+  }
+}
+
+template <typename Index>
+std::vector<BasicAnchor<Index> > 
+BasicAnchorAnalysis<Index>::findMinimizerAnchors(
+    TokenRange sourceTokenStream,
+    TokenRange targetTokenStream, Index k, Index w) {
+  const TokenText<Index> text(sourceTokenStream, targetTokenStream);
+
+  // Any match of at least w + k - 1 tokens contains a window of w k-mers, 
+  // whose minimizer is then picked on both sides.
+  std::vector<Minimizer<Index> > minimizers;
+  sampleMinimizers(text, (Index)0, text.sourceSize, k, w, minimizers);
+  sampleMinimizers(text, text.targetStart, text.size - 1, k, w, minimizers);
+
+  // Group equal minimizers, which is what a hash table of them would do, 
+  // and pair up the occurrences in each group. Sorting keeps the memory to
+  // the minimizers themselves.
+  std::sort(minimizers.begin(), minimizers.end());
+  std::vector<Seed<Index> > seeds;
+  for (size_t i = 0, e = minimizers.size(); i < e;) {
+    size_t j = i + 1;
+    while (j < e && minimizers[j].hash == minimizers[i].hash)
+      ++j;
+    if (j - i <= (size_t)MaxSeedOccurrences)
+      for (size_t a = i; a < j; ++a)
+        for (size_t b = a + 1; b < j; ++b) {
+          const Seed<Index> seed = { minimizers[a].pos, minimizers[b].pos };
+          seeds.push_back(seed);
+        }
+    i = j;
+  }
+  std::vector<Minimizer<Index> >().swap(minimizers);
+
+  // Seeds on one diagonal that are close together belong to one run of 
+  // matching tokens. Extend each run once into a maximal match; seeds it 
+  // covers are skipped. Matches shorter than a k-mer are hash collisions.
+  std::sort(seeds.begin(), seeds.end(), Seed<Index>::byDiagonal);
+  std::vector<Anchor> matches;
+  Index diagonal = 0, covered = -1;
+  typename std::vector<Seed<Index> >::const_iterator i(seeds.begin()), 
+                                                     e(seeds.end());
+  for (; i != e; ++i) {
+    if (i->y - i->x == diagonal && i->x < covered)
+      continue;
+    Index x = i->x, y = i->y, len = 0;
+    while (x > 0 && text[x - 1] == text[y - 1] && text[x - 1] > 1) {
+      --x;
+      --y;
+      ++len;
+    }
+    while (text[x + len] == text[y + len] && text[x + len] > 1)
+      ++len;
+    diagonal = i->y - i->x;
+    covered = x + len;
+    if (len >= k)
+      matches.push_back(Anchor(x, y, len));
+  }
+  std::vector<Seed<Index> >().swap(seeds);
+
+  // Classify the matches longest first, like the LCPs of a suffix array.
+  std::stable_sort(matches.begin(), matches.end(), std::greater<Anchor>());
+  AnchorSet<Index> crossAnchors, sourceAnchors, targetAnchors;
+  typename std::vector<Anchor>::const_iterator m(matches.begin()), 
+                                               me(matches.end());
+  for (; m != me; ++m)
+    classifyAnchor(*m, text.sourceSize, text.targetStart,
+                   sourceAnchors, targetAnchors, crossAnchors);
+  discardConfusingAnchors(sourceAnchors.anchors(), targetAnchors.anchors(),
+                          crossAnchors.anchors());
+  extendAnchors(crossAnchors.anchors(), sourceTokenStream, targetTokenStream);
+  return crossAnchors.anchors();
+}
+
+template <typename Index>
+std::vector<BasicAnchor<Index> > BasicAnchorAnalysis<Index>::findSparseAnchors(
+    TokenRange sourceTokenStream,
+    TokenRange targetTokenStream, Index k) {
+  // Positions count as in the suffix array of both streams.
+  const TokenText<Index> text(sourceTokenStream, targetTokenStream);
+  const Index sourceTokenStreamSize = text.sourceSize;
+  const Index targetStart = text.targetStart, size = text.size;
+  auto lineAt = [&](Index p) { return text.token(p).getLine(); };
+
+  // Cut the streams into segments. Whether a segment starts at a token 
+  // depends only on the token and the one before it, so equal text is cut
+  // the same way wherever it occurs. Each sentinel is a segment of its own;
+  // segmentStarts has an extra entry for the end.
+  std::vector<Index> segmentStarts;
+  for (Index p = 0; p < size; ++p) {
+    const Index id = text[p];
+    if (id <= 1 || p == 0 || p == targetStart || id % k == 0 ||
+        lineAt(p) != lineAt(p - 1))
+      segmentStarts.push_back(p);
+  }
+  const Index nSegments = segmentStarts.size();
+  segmentStarts.push_back(size);
+
+  // Name the segments by sorting them, so that equal segments get equal 
+  // names. Names start above the sentinels'.
+  std::vector<Index> segments;
+  segments.reserve(nSegments);
+  for (Index l = 0; l < nSegments; ++l)
+    if (text[segmentStarts[l]] > 1)
+      segments.push_back(l);
+  auto segmentLess = [&](Index a, Index b) {
+    Index i = segmentStarts[a], j = segmentStarts[b];
+    const Index ie = segmentStarts[a + 1], je = segmentStarts[b + 1];
+    for (; i < ie && j < je; ++i, ++j)
+      if (text[i] != text[j])
+        return text[i] < text[j];
+    return i == ie && j < je;
+  };
+  std::sort(segments.begin(), segments.end(), segmentLess);
+  std::vector<Index> segmentText(nSegments);
+  for (Index l = 0; l < nSegments; ++l)
+    segmentText[l] = text[segmentStarts[l]];
+  Index name = 1;
+  for (Index l = 0, e = segments.size(); l < e; ++l) {
+    if (l == 0 || segmentLess(segments[l - 1], segments[l]))
+      ++name;
+    segmentText[segments[l]] = name;
+  }
+  std::vector<Index>().swap(segments);
+
+  // Neighbouring segment suffixes share whole segments. Extend every such 
+  // match by the tokens the segments around it have in common, at most one
+  // segment either way, to get the match in tokens.
+  std::vector<Anchor> matches;
+  {
+    const BasicSuffixArray<Index> sa(segmentText, construction);
+    std::vector<Index>().swap(segmentText);
+    const std::vector<Index> &indexPoints = sa.orderedIndexPoints();
+    const std::vector<Index> &LCPs = sa.LCPs();
+    for (Index r = 1; r < nSegments; ++r) {
+      if (LCPs[r] == 0)
+        continue;
+      const Index lx = indexPoints[r], ly = indexPoints[r - 1];
+      Index x = segmentStarts[lx], y = segmentStarts[ly];
+      Index len = segmentStarts[lx + LCPs[r]] - x;
+      for (Index e = segmentStarts[std::min(lx + LCPs[r] + 1, nSegments)] - x;
+           len < e && text[x + len] == text[y + len] && 
+           text[x + len] > 1; ++len);
+      for (Index e = (lx > 0) ? segmentStarts[lx - 1] : 0; 
+           x > e && y > 0 && text[x - 1] == text[y - 1] && 
+           text[x - 1] > 1; --x, --y, ++len);
+      if (len > 1)
+        matches.push_back(Anchor(x, y, len));
+    }
+  }
+
+  // Classify the matches longest first, like the LCPs of a full suffix 
+  // array.
+  std::stable_sort(matches.begin(), matches.end(), std::greater<Anchor>());
+  AnchorSet<Index> crossAnchors, sourceAnchors, targetAnchors;
+  typename std::vector<Anchor>::const_iterator i(matches.begin()), 
+                                               e(matches.end());
+  for (; i != e; ++i)
+    classifyAnchor(*i, sourceTokenStreamSize, targetStart,
+                   sourceAnchors, targetAnchors, crossAnchors);
+  discardConfusingAnchors(sourceAnchors.anchors(), targetAnchors.anchors(),
+                          crossAnchors.anchors());
+  extendAnchors(crossAnchors.anchors(), sourceTokenStream, targetTokenStream);
+  return crossAnchors.anchors();
+}
+
+template <typename Index>
+std::vector<BasicAnchor<Index> > BasicAnchorAnalysis<Index>::classifyAnchors(
+    const std::vector<Index> &indexPoints, const std::vector<Index> &LCPs,
+    Index sourceTokenStreamSize, Index targetStart) {
+  AnchorSet<Index> crossAnchors, sourceAnchors, targetAnchors;
+
+  // Visit the neighbours longest LCP first, and neighbours with equal LCPs 
+  // in suffix array order. LCPs of 0 and 1 are worthless as anchors. No LCP
+  // exceeds the length of the text, so a counting sort puts them in this 
+  // order in linear time.
+  const Index n = LCPs.size();
+  Index maxLCP = 1;
+  for (Index i = 1; i < n; ++i)
+    maxLCP = std::max(maxLCP, LCPs[i]);
+  std::vector<Index> bucketStarts(maxLCP + 1, 0);
+  for (Index i = 1; i < n; ++i)
+    if (LCPs[i] > 1)
+      ++bucketStarts[maxLCP - LCPs[i] + 1];
+  for (Index len = 1; len <= maxLCP; ++len)
+    bucketStarts[len] += bucketStarts[len - 1];
+  std::vector<Index> order(bucketStarts[maxLCP]);
+  for (Index i = 1; i < n; ++i)
+    if (LCPs[i] > 1)
+      order[bucketStarts[maxLCP - LCPs[i]]++] = i;
+
+  typename std::vector<Index>::const_iterator i(order.begin()), e(order.end());
+  for (; i != e; ++i) {
+    const Index idx = *i;
+    const Index x = indexPoints[idx];
+    const Index y = indexPoints[idx - 1];
+    const Index len = LCPs[idx];
+    classifyAnchor(Anchor(x, y, len), sourceTokenStreamSize, targetStart,
+                   sourceAnchors, targetAnchors, crossAnchors);
   }
 
   // Some anchors might have been identifed because we were looking at such 
@@ -84,49 +834,322 @@ std::vector<Anchor> AnchorAnalysis::findAnchors(
   // high, rather than because these are actually two common blocks preserved
   // across. Detect them now and avoid considering them for the rest of the 
   // comparison algorithm.
-  discardConfusingAnchors(sourceAnchors, targetAnchors, crossAnchors);  
-	return crossAnchors;
+  discardConfusingAnchors(sourceAnchors.anchors(), targetAnchors.anchors(),
+                          crossAnchors.anchors());
+  return crossAnchors.anchors();
+}
+
+template <typename Index>
+void BasicAnchorAnalysis<Index>::classifyAnchor(const Anchor &match,
+    Index sourceTokenStreamSize, Index targetStart,
+    AnchorSet<Index> &sourceAnchors, AnchorSet<Index> &targetAnchors,
+    AnchorSet<Index> &crossAnchors) {
+  const Index x = match.sourceIdx();
+  const Index y = match.targetIdx();
+  const Index len = match.length();
+  // First check for self-anchors. Self-anchors represent the common 
+  // substrings found when considering a file with itself. They give us a 
+  // way to express self similarity by providing a measure on the 
+  // distribution of common substrings for that file. By getting an idea of 
+  // how similar two files are with themselves, we can get a better feel for 
+  // the statistical significance of common substrings between two files to
+  // later set some threshold level.
+  //
+  // We say an anchor is a self anchor from the source stream when both
+  // indexes x and y are found in the source stream.
+  //
+  // We say an anchor is a self anchor from the target stream when both
+  // indexes x and y are found in the target stream.
+  if ((x < sourceTokenStreamSize) && (y < sourceTokenStreamSize)) {
+    sourceAnchors.insert(Anchor(x, y, len));
+  } else if ((targetStart <= x) && (targetStart <= y)) {
+    targetAnchors.insert(Anchor(x - targetStart, y - targetStart, len));
+  } else {
+    // Check for a maximal cross anchor. Cross anchors represent common 
+    // substrings between two files. We need to consider two cases here:
+    //  1) When x is in the source stream and y is in the target stream
+    //  2) When y is in the source stream and x is in the target stream
+    if ((x < sourceTokenStreamSize) && (targetStart <= y)) {
+      crossAnchors.insert(Anchor(x, y - targetStart, len));
+    }
+    else if ((y < sourceTokenStreamSize) && (targetStart <= x)) {
+      crossAnchors.insert(Anchor(y, x - targetStart, len));
+    }
+  }
 }
 
-void AnchorAnalysis::discardConfusingAnchors(const std::vector<Anchor> &sourceAnchors, 
-                                             const std::vector<Anchor> &targetAnchors, 
-                                             std::vector<Anchor> &crossAnchors) {
+template <typename Index>
+std::vector<BasicAnchor<Index> > BasicAnchorAnalysis<Index>::findAnchors(
+    const ReferenceIndex &index, Index first,
+    TokenRange sourceTokenStream,
+    TokenRange targetTokenStream,
+    const std::vector<int> &targetIds) {
+  const Index n = index.size(), sourceSize = sourceTokenStream.size();
+  const Index last = first + sourceSize, m = targetIds.size();
+  if (sourceSize == 0 || m == 0)
+    return std::vector<Anchor>();
+  const int32_t *ids = index.tokenIds(), *SA = index.suffixArray();
+
+  // The anchors are the ones findAnchors finds in the joint suffix array of
+  // the source and target, which is the suffix array of the source alone 
+  // with the target's suffixes merged in. The index gives the former in 
+  // linear time and a binary search per target suffix the latter.
+  std::vector<Index> sourceSA(sourceSize), sourceLCPs(sourceSize, 0);
+  {
+    const std::vector<Index> indexPoints(SA, SA + n), 
+                             LCPs(index.LCPs(), index.LCPs() + n);
+    const LongestCommonExtension<Index> lce(indexPoints, LCPs);
+
+    // The longest repeat within the source, whose suffixes end at last: 
+    // repeat is the longest match between the suffix at r and one of the 
+    // source suffixes before it, and between holds the LCP since the last
+    // of them.
+    Index longestRepeat = 0, repeat = 0, between = 0, previous = -1;
+    for (Index r = 0; r < n; ++r) {
+      if (r > 0)
+        between = std::min(between, LCPs[r]);
+      const Index p = SA[r];
+      if (p < first || p >= last)
+        continue;
+      if (previous >= 0) {
+        repeat = std::min(between, std::max(repeat, last - previous));
+        longestRepeat = std::max(longestRepeat, std::min(repeat, last - p));
+      }
+      previous = p;
+      between = n;
+    }
+
+    // Cut off at last, the source suffixes sort as the reference's do, 
+    // unless one of them is a prefix of another and comes first. Only the 
+    // ones short enough to repeat can be: sort those apart and merge them 
+    // in.
+    auto sourceLess = [&](Index p, Index q) {
+      if (p == q)
+        return false;
+      if (lce.query(p, q) < last - std::max(p, q))
+        return lce.rank(p) < lce.rank(q);
+      return p > q;
+    };
+    const Index tail = last - std::min(longestRepeat, sourceSize);
+    std::vector<Index> longSuffixes, shortSuffixes;
+    longSuffixes.reserve(tail - first);
+    for (Index r = 0; r < n; ++r)
+      if (SA[r] >= first && SA[r] < tail)
+        longSuffixes.push_back(SA[r]);
+    for (Index p = tail; p < last; ++p)
+      shortSuffixes.push_back(p);
+    std::sort(shortSuffixes.begin(), shortSuffixes.end(), sourceLess);
+    std::merge(longSuffixes.begin(), longSuffixes.end(), 
+               shortSuffixes.begin(), shortSuffixes.end(), sourceSA.begin(),
+               sourceLess);
+    for (Index k = sourceSize - 1; k >= 0; --k) {
+      if (k > 0)
+        sourceLCPs[k] = std::min(lce.query(sourceSA[k - 1], sourceSA[k]),
+                                 last - std::max(sourceSA[k - 1], 
+                                                 sourceSA[k]));
+      sourceSA[k] -= first;
+    }
+  }
+  std::vector<Index> sourceRanks(sourceSize);
+  for (Index k = 0; k < sourceSize; ++k)
+    sourceRanks[sourceSA[k]] = k;
+  const RangeMinimum<Index> minLCP(sourceLCPs);
+
+  // Find where every target suffix goes, and its LCPs with the source 
+  // suffixes on either side, by matching statistics: the suffixes that 
+  // start with the l tokens matched from j on make up the interval 
+  // [lo, hi], which every further token narrows by binary search. One 
+  // position on, the l - 1 tokens left are matched by the suffix behind 
+  // one of them, and the interval widens around its rank to the neighbours 
+  // that share them. As in the joint suffix array, a source suffix that 
+  // ends sorts first, then a target suffix that ends, and a token the 
+  // source does not have sorts last.
+  auto sourceAt = [&](Index k, Index l) {
+    const Index x = sourceSA[k] + l;
+    return (x < sourceSize) ? (Index)ids[first + x] : (Index)0;
+  };
+  auto targetAt = [&](Index j) {
+    return (j == m) ? (Index)1 : (targetIds[j] < 0) ? 
+      std::numeric_limits<Index>::max() : (Index)targetIds[j];
+  };
+  auto lowerBound = [&](Index a, Index b, Index l, Index id) {
+    while (a < b) {
+      const Index mid = a + (b - a) / 2;
+      if (sourceAt(mid, l) < id)
+        a = mid + 1;
+      else
+        b = mid;
+    }
+    return a;
+  };
+
+  // widen - Returns the last rank from r on in direction dir whose suffix 
+  // shares l tokens with the one at r. Intervals are mostly small, so it 
+  // gallops out from r before it searches.
+  auto widen = [&](Index r, Index dir, Index l) {
+    auto shares = [&](Index d) {
+      const Index k = r + dir * d;
+      return k >= 0 && k < sourceSize && 
+        minLCP.query(std::min(r, k) + 1, std::max(r, k)) >= l;
+    };
+    Index good = 0, bad = 1;
+    while (shares(bad)) {
+      good = bad;
+      bad *= 2;
+    }
+    while (bad - good > 1) {
+      const Index mid = good + (bad - good) / 2;
+      if (shares(mid))
+        good = mid;
+      else
+        bad = mid;
+    }
+    return r + dir * good;
+  };
+  std::vector<Index> inserts(m), leftLCPs(m), rightLCPs(m);
+  Index lo = 0, hi = sourceSize - 1, l = 0;
+  for (Index j = 0; j < m; ++j) {
+    for (; j + l < m && targetIds[j + l] >= 0; ++l) {
+      const Index a = lowerBound(lo, hi + 1, l, targetIds[j + l]);
+      const Index b = lowerBound(a, hi + 1, l, targetIds[j + l] + 1);
+      if (a == b)
+        break;
+      lo = a;
+      hi = b - 1;
+    }
+    const Index k = lowerBound(lo, hi + 1, l, targetAt(j + l));
+    inserts[j] = k;
+    leftLCPs[j] = (k > lo) ? l : (k > 0) ? sourceLCPs[k] : 0;
+    rightLCPs[j] = (k <= hi) ? l : (k < sourceSize) ? sourceLCPs[k] : 0;
+
+    if (l <= 1) {
+      lo = 0;
+      hi = sourceSize - 1;
+      l = 0;
+      continue;
+    }
+    --l;
+    const Index r = sourceRanks[sourceSA[lo] + 1];
+    lo = widen(r, -1, l);
+    hi = widen(r, 1, l);
+  }
+
+  // Walk the joint suffix array: the target suffixes inserted at rank k of
+  // the source's come right before the source suffix of that rank. Take 
+  // the cross anchors between neighbours in this order, and the longest 
+  // self anchors for the threshold of discardConfusingAnchorsI.
+  const BasicSuffixArray<Index> targetSA(targetTokenStream, TokenRange(), 
+                                         construction);
+  const std::vector<Index> &targetIndexPoints = targetSA.orderedIndexPoints();
+  const std::vector<Index> &targetLCPs = targetSA.LCPs();
+  std::vector<Anchor> matches;
+  Index maxSelf = 0, t = 0;
+  const Index te = targetIndexPoints.size();
+  for (Index k = 0; k <= sourceSize; ++k) {
+    bool gap = false;
+    for (; t < te && (targetIndexPoints[t] >= m || 
+                      inserts[targetIndexPoints[t]] <= k); ++t) {
+      const Index j = targetIndexPoints[t];
+      if (j >= m)
+        continue;
+      if (gap)
+        maxSelf = std::max(maxSelf, targetLCPs[t]);
+      else if (k > 0 && leftLCPs[j] > 1)
+        matches.push_back(Anchor(sourceSA[k - 1], j, leftLCPs[j]));
+      gap = true;
+    }
+    if (k == sourceSize)
+      break;
+    if (gap) {
+      const Index j = targetIndexPoints[t - 1];
+      if (rightLCPs[j] > 1)
+        matches.push_back(Anchor(sourceSA[k], j, rightLCPs[j]));
+    } else if (k > 0) {
+      maxSelf = std::max(maxSelf, sourceLCPs[k]);
+    }
+  }
+
+  // Classify the matches longest first, and neighbours with equal LCPs in
+  // suffix array order, as classifyAnchors does.
+  std::stable_sort(matches.begin(), matches.end(), std::greater<Anchor>());
+  AnchorSet<Index> maximalAnchors;
+  for (Index i = 0, e = matches.size(); i < e; ++i)
+    maximalAnchors.insert(matches[i]);
+  std::vector<Anchor> &crossAnchors = maximalAnchors.anchors();
+  while (!crossAnchors.empty() && crossAnchors.back().length() < maxSelf)
+    crossAnchors.pop_back();
+  alignCrossAnchors(crossAnchors);
+  extendAnchors(crossAnchors, sourceTokenStream, targetTokenStream);
+  return crossAnchors;
+}
+
+template <typename Index>
+void BasicAnchorAnalysis<Index>::discardConfusingAnchors(
+    const std::vector<Anchor> &sourceAnchors, 
+    const std::vector<Anchor> &targetAnchors, 
+    std::vector<Anchor> &crossAnchors) {
   discardConfusingAnchorsI(sourceAnchors, targetAnchors, crossAnchors);
+  alignCrossAnchors(crossAnchors);
+}
+
+template <typename Index>
+void BasicAnchorAnalysis<Index>::alignCrossAnchors(
+    std::vector<Anchor> &crossAnchors) {
   std::vector<Anchor> perm0(crossAnchors), perm1(crossAnchors);
-  std::sort(perm0.begin(), perm0.end(), compareSourceIndex);
-  std::sort(perm1.begin(), perm1.end(), compareTargetIndex);
-  crossAnchors = (perm0 == perm1) ? perm0 : alignAnchors(perm0, perm1);
+  std::sort(perm0.begin(), perm0.end(), compareSourceIndex<Index>);
+  std::sort(perm1.begin(), perm1.end(), compareTargetIndex<Index>);
+  if (perm0 == perm1) {
+    crossAnchors.swap(perm0);
+    return;
+  }
+  crossAnchors = alignAnchors(perm0, perm1);
+
+  // The aligned anchors are a subsequence of perm0.
+  if (unalignedAnchors) {
+    typename std::vector<Anchor>::const_iterator 
+      aligned(crossAnchors.begin()), alignedEnd(crossAnchors.end());
+    for (Index i = 0, e = perm0.size(); i < e; ++i) {
+      if (aligned != alignedEnd && *aligned == perm0[i])
+        ++aligned;
+      else
+        unalignedAnchors->push_back(perm0[i]);
+    }
+  }
 }
 
-void AnchorAnalysis::discardConfusingAnchorsI(const std::vector<Anchor> &sourceAnchors, 
-                                              const std::vector<Anchor> &targetAnchors, 
-                                              std::vector<Anchor> &crossAnchors) {
-  const int maxself0 = !sourceAnchors.empty() ? sourceAnchors.front().length() : 0;
-  const int maxself1 = !targetAnchors.empty() ? targetAnchors.front().length() : 0;
-  int thresh = (maxself0 > maxself1) ? maxself0 : maxself1; 
+template <typename Index>
+void BasicAnchorAnalysis<Index>::discardConfusingAnchorsI(
+    const std::vector<Anchor> &sourceAnchors, 
+    const std::vector<Anchor> &targetAnchors, 
+    std::vector<Anchor> &crossAnchors) {
+  const Index maxself0 = !sourceAnchors.empty() ? sourceAnchors.front().length() : 0;
+  const Index maxself1 = !targetAnchors.empty() ? targetAnchors.front().length() : 0;
+  Index thresh = (maxself0 > maxself1) ? maxself0 : maxself1; 
 
   // Discard anchors falling below the computed threshold.
 	while (!crossAnchors.empty() && crossAnchors.back().length() < thresh)
 		crossAnchors.pop_back();
 }
 
-void AnchorAnalysis::discardConfusingAnchorsII(const std::vector<Anchor> &sourceAnchors, 
-                                               const std::vector<Anchor> &targetAnchors, 
-                                               std::vector<Anchor> &crossAnchors) {
+template <typename Index>
+void BasicAnchorAnalysis<Index>::discardConfusingAnchorsII(
+    const std::vector<Anchor> &sourceAnchors, 
+    const std::vector<Anchor> &targetAnchors, 
+    std::vector<Anchor> &crossAnchors) {
   std::vector<Anchor> anchs;
   anchs.insert(anchs.end(), sourceAnchors.begin(), sourceAnchors.end());
   anchs.insert(anchs.end(), targetAnchors.begin(), targetAnchors.end());
   anchs.insert(anchs.end(), crossAnchors.begin(), crossAnchors.end());
 
-	int thresh = crossAnchors.front().length(), savedThresh = 0;
+	Index thresh = crossAnchors.front().length(), savedThresh = 0;
 	do {		
 		// Partition the anchors into two sets by comparing 
     // their lengths to the current threshold level.
     savedThresh = thresh;
-		int m1 = 0, m2 = 0, nBelow = 0, nAbove = 0;
-		std::vector<Anchor>::iterator i(anchs.begin()), e(anchs.end());
+		Index m1 = 0, m2 = 0, nBelow = 0, nAbove = 0;
+		typename std::vector<Anchor>::iterator i(anchs.begin()), e(anchs.end());
 		for (; i != e; ++i) {
-      const int len = (*i).length();
+      const Index len = (*i).length();
 			if (len > thresh) { ++nAbove;  m2 += len; } 
       else { ++nBelow;  m1 += len; }
 		}
@@ -140,64 +1163,45 @@ void AnchorAnalysis::discardConfusingAnchorsII(const std::vector<Anchor> &source
 		crossAnchors.pop_back();
 }
 
-std::vector<Anchor> AnchorAnalysis::alignAnchors(const std::vector<Anchor> &perm0, 
-                                                 const std::vector<Anchor> &perm1) {
-	const int nAnchs = perm0.size();
-	std::vector<std::vector<int> > LCSTable(nAnchs+1);
-  for (int i = 0, e = nAnchs + 1; i < e; ++i)
-    LCSTable[i].resize(nAnchs+1);
-	
-	for (int i = nAnchs - 1; i >= 0; --i) {
-		for (int j = nAnchs - 1; j >= 0; --j) {
-			if (perm0[i] == perm1[j]) 
-        LCSTable[i][j] = LCSTable[i+1][j+1]+1;
-      else 
-        LCSTable[i][j] = std::max(LCSTable[i+1][j], LCSTable[i][j+1]);
-    }
-	}
-  std::vector<Anchor> anchList;
-  anchList.reserve(nAnchs);
-  for (int i=0, j=0; ((i < nAnchs) && (j < nAnchs)); ) {
-    if (perm0[i] == perm1[j]) {
-      anchList.push_back(perm0[i]);
-      i++; j++;
-    } else if (LCSTable[i][j+1] < LCSTable[i+1][j]) {
-      ++i;
-    } else {
-      ++j;
-    }
+template <typename Index>
+std::vector<BasicAnchor<Index> > 
+BasicAnchorAnalysis<Index>::alignAnchors(const std::vector<Anchor> &perm0, 
+                                         const std::vector<Anchor> &perm1) {
+  // Both permutations hold the same anchors, and no two of them start at 
+  // the same position in either stream. Numbered by their place in perm1,
+  // the anchors of a colinear subset are those whose numbers increase along
+  // perm0. Keep the one that anchors the most tokens: the heaviest chain 
+  // ending at each anchor extends the heaviest one among the anchors before
+  // it in both orders, which a Fenwick tree over the numbers finds in 
+  // O(log A).
+  const Index nAnchs = perm0.size();
+  std::vector<Index> weights(nAnchs), previous(nAnchs);
+  std::vector<Index> heaviest(nAnchs + 1, -1);
+  for (Index i = 0; i < nAnchs; ++i) {
+    const Index rank = std::lower_bound(perm1.begin(), perm1.end(), perm0[i], 
+                                        compareTargetIndex<Index>) - 
+                       perm1.begin();
+    Index best = -1;
+    for (Index k = rank; k > 0; k -= k & -k)
+      if (heaviest[k] >= 0 && (best < 0 || weights[heaviest[k]] > weights[best]))
+        best = heaviest[k];
+    previous[i] = best;
+    weights[i] = perm0[i].length() + (best < 0 ? 0 : weights[best]);
+    for (Index k = rank + 1; k <= nAnchs; k += k & -k)
+      if (heaviest[k] < 0 || weights[i] > weights[heaviest[k]])
+        heaviest[k] = i;
   }
+
+  Index last = -1;
+  for (Index i = 0; i < nAnchs; ++i)
+    if (last < 0 || weights[i] > weights[last])
+      last = i;
+  std::vector<Anchor> anchList;
+  for (Index i = last; i >= 0; i = previous[i])
+    anchList.push_back(perm0[i]);
+  std::reverse(anchList.begin(), anchList.end());
   return anchList;
 }
 
-bool AnchorAnalysis::isMaximal(const Anchor &anch, 
-                               const std::vector<Anchor> &anchors) {
-  const int firstBegin = anch.sourceIdx(),
-            firstEnd = anch.sourceIdx() + anch.length();
-
-  const int secondBegin = anch.targetIdx(),
-            secondEnd = anch.targetIdx() + anch.length();
-
-  std::vector<Anchor>::const_iterator i(anchors.begin()), e(anchors.end());
-  for (; i != e; ++i) {
-    const int firstLowBound = (*i).sourceIdx(),
-              firstUpBound = (*i).sourceIdx() + (*i).length();
-
-    const int secondLowBound = (*i).targetIdx(),
-              secondUpBound = (*i).targetIdx() + (*i).length();
-
-		if ((firstLowBound <= firstBegin) && 
-        (firstBegin < firstUpBound)) 
-      return false;
-    if ((firstLowBound <= firstEnd) && 
-        (firstEnd < firstUpBound)) 
-      return false;
-		if ((secondLowBound <= secondBegin) && 
-        (secondBegin < secondUpBound)) 
-      return false;
-    if ((secondLowBound <= secondEnd) && 
-        (secondEnd < secondUpBound)) 
-      return false;
-  }
-	return true;
-}
+template class BasicAnchorAnalysis<int>;
+template class BasicAnchorAnalysis<int64_t>;
@@ -11,20 +11,116 @@
 #ifndef ANCHORANALYSIS_H
 #define ANCHORANALYSIS_H
 
+#include "SuffixArray.h"
 #include <vector>
 
-class Anchor;
+template <typename Index> class AnchorSet;
+template <typename Index> class BasicAnchor;
+template <typename Index> class BasicExternalSuffixArray;
+class ReferenceIndex;
 class Token;
 
-class AnchorAnalysis {
+/// BasicAnchorAnalysis - Finds the anchors between two token streams with a 
+/// BasicSuffixArray of the same index type.
+template <typename Index>
+class BasicAnchorAnalysis {
+  typedef BasicAnchor<Index> Anchor;
+
+  /// The algorithm used to build suffix arrays.
+  SuffixArrayBase::Construction construction;
+
+  /// Where to keep the cross anchors alignCrossAnchors drops, or null.
+  std::vector<Anchor> *unalignedAnchors;
+
+  /// The most substituted tokens an anchor of findAnchors may hold.
+  Index maxMismatches;
 public:
-  AnchorAnalysis() {}
-  ~AnchorAnalysis() {}
+  explicit BasicAnchorAnalysis(SuffixArrayBase::Construction algorithm = 
+                                 SuffixArrayBase::AutomaticConstruction)
+    : construction(algorithm), unalignedAnchors(0), maxMismatches(0) {}
+  ~BasicAnchorAnalysis() {}
+
+  /// setUnalignedAnchors - Append the cross anchors that are long enough to
+  /// keep but out of order with the others, the blocks that were moved, to
+  /// anchors from now on. Must be left null for the anchors of several 
+  /// targets at once, which are classified in parallel.
+  void setUnalignedAnchors(std::vector<Anchor> *anchors) {
+    unalignedAnchors = anchors;
+  }
+
+  /// setMismatches - Let findAnchors of two streams find anchors with up to
+  /// k substituted tokens, seeded by the suffix array's neighbours and 
+  /// extended past the substitutions; they are returned as the runs of 
+  /// matching tokens between them. Lightly edited code, such as a variable 
+  /// renamed on every line, then lines up without any long exact anchor.
+  void setMismatches(Index k) {
+    maxMismatches = k;
+  }
 
   /// findAnchors - Identify and return a vector of Anchors representing the 
   /// long common subsequecnes of the source and target token data streams.
-  std::vector<Anchor> findAnchors(const std::vector<Token> sourceTokenStream,
-                                  const std::vector<Token> targetTokenStream);
+  /// Like the anchors of every other way of finding them below, each is 
+  /// carried on past a few substituted tokens while the tokens behind them 
+  /// match, and merged with the next if it runs into it.
+  std::vector<Anchor> findAnchors(TokenRange sourceTokenStream,
+                                  TokenRange targetTokenStream);
+
+  /// findSparseAnchors - Like findAnchors, but sorts only the suffixes that 
+  /// start a segment, as a suffix array over a text of one name per 
+  /// segment. Segments start at every line and at every token whose id is a
+  /// multiple of k, so that equal text is cut into equal segments in both 
+  /// streams and about one suffix in k is sorted. Matches of whole segments
+  /// are extended by the tokens the segments around them share.
+  std::vector<Anchor> findSparseAnchors(
+      TokenRange sourceTokenStream,
+      TokenRange targetTokenStream, Index k);
+
+  /// findMinimizerAnchors - Like findAnchors, but seeds matches with the 
+  /// (w,k)-minimizers of both streams instead of sorting any suffixes: of 
+  /// every w consecutive runs of k tokens, the one with the smallest hash. 
+  /// Equal minimizers are paired up, and the seeds of a run of matching 
+  /// tokens are extended once into a maximal match. Matches of fewer than 
+  /// w + k - 1 tokens can be missed.
+  std::vector<Anchor> findMinimizerAnchors(
+      TokenRange sourceTokenStream,
+      TokenRange targetTokenStream, Index k, Index w);
+
+  /// findAnchors - Like findAnchors, but with the suffix array sa built in
+  /// temporary files instead of memory. Candidate anchors are sorted on disk
+  /// as well, so only the anchors themselves are kept in memory. Returns 
+  /// false if a temporary file could not be written.
+  bool findAnchors(TokenRange sourceTokenStream,
+                   TokenRange targetTokenStream,
+                   BasicExternalSuffixArray<Index> &sa,
+                   std::vector<Anchor> &crossAnchors);
+
+  /// findAnchors - Identify the anchors between the source and each of the
+  /// target token streams with one generalized suffix array of all of them.
+  /// The anchors of the source and target k are the ones findAnchors would
+  /// find for that pair alone; they are classified in parallel.
+  std::vector<std::vector<Anchor> > findAnchors(
+      TokenRange sourceTokenStream,
+      const std::vector<TokenRange> &targetTokenStreams);
+
+  /// findBatchAnchors - Identify the anchors of many pairs of token streams
+  /// with one generalized suffix array of all of them, which spares the 
+  /// setup of a suffix array per pair when the pairs are small. Streams 2p 
+  /// and 2p + 1 are the source and target of pair p; the ids of their 
+  /// tokens must leave room for a sentinel per stream. The anchors of pair p
+  /// are the ones findAnchors would find for it alone.
+  std::vector<std::vector<Anchor> > findBatchAnchors(
+      const std::vector<TokenRange> &tokenStreams);
+
+  /// findAnchors - Identify the anchors between a source stream covered by a
+  /// prebuilt ReferenceIndex and a target stream, without sorting the
+  /// suffixes of the source. The source stream consists of the reference's 
+  /// tokens from first on, and targetIds holds the ids the index gives to 
+  /// the target's tokens. The anchors are the ones findAnchors of the two 
+  /// streams finds.
+  std::vector<Anchor> findAnchors(const ReferenceIndex &index, Index first,
+                                  TokenRange sourceTokenStream,
+                                  TokenRange targetTokenStream,
+                                  const std::vector<int> &targetIds);
 
   /// discardConfusingAnchors - Computes a global threshold level used to 
   /// eliminate anchors which have a length below this value. The goal of this 
@@ -34,15 +130,33 @@ public:
                                const std::vector<Anchor> &targetAnchors, 
                                std::vector<Anchor> &crossAnchors);
 
-  /// alignAnchors - Given two permutations of a set of Anchors, finds the longest 
-  /// subsequence common to both arrangements and returns the subset of Anchors 
-  /// comprising it.
+  /// alignAnchors - Given a set of Anchors sorted by source index in perm0 
+  /// and by target index in perm1, finds the subsequence common to both 
+  /// arrangements that covers the most tokens and returns the subset of 
+  /// Anchors comprising it, in source order. Takes O(A log A) time.
   std::vector<Anchor> alignAnchors(const std::vector<Anchor> &perm0, 
                                    const std::vector<Anchor> &perm1);
 private:
-  /// isMaximal - Returns true if the Anchor Anch is not in AnchList, or not
-  /// contained within any other Anchor in AnchList
-  bool isMaximal(const Anchor &anch, const std::vector<Anchor> &anchors);
+  /// classifyAnchors - Turn the neighbouring suffixes of a suffix array over
+  /// the source and one target into self and cross anchors, longest first,
+  /// and return the cross anchors that survive discardConfusingAnchors. The
+  /// source starts at index point 0 and the target at targetStart.
+  std::vector<Anchor> classifyAnchors(const std::vector<Index> &indexPoints,
+                                      const std::vector<Index> &LCPs,
+                                      Index sourceTokenStreamSize,
+                                      Index targetStart);
+
+  /// classifyAnchor - Add match, a common substring at two positions of the
+  /// suffix array text, to the source, target or cross anchors it belongs
+  /// to, unless it overlaps one of them.
+  void classifyAnchor(const Anchor &match, Index sourceTokenStreamSize, 
+                      Index targetStart, AnchorSet<Index> &sourceAnchors,
+                      AnchorSet<Index> &targetAnchors,
+                      AnchorSet<Index> &crossAnchors);
+
+  /// alignCrossAnchors - Keep only the cross anchors that appear in the same
+  /// order in both streams.
+  void alignCrossAnchors(std::vector<Anchor> &crossAnchors);
 
   /// Computes a global threshold level by taking the length of the first 
   /// cross-anchor that is larger than all self-anchors as the minimum 
@@ -62,4 +176,10 @@ private:
                                  std::vector<Anchor> &crossAnchors);
 };
 
+/// AnchorAnalysis - The default, 32-bit anchor analysis.
+typedef BasicAnchorAnalysis<int> AnchorAnalysis;
+
+/// AnchorAnalysis64 - Anchor analysis of more than 2^31 tokens.
+typedef BasicAnchorAnalysis<int64_t> AnchorAnalysis64;
+
 #endif // ANCHORANALYSIS_H
@@ -0,0 +1,91 @@
+//===--- AnchorSet.h - Anchors that do not overlap ------------*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines the AnchorSet interface.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef ANCHORSET_H
+#define ANCHORSET_H
+
+#include "Anchor.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+/// AnchorSet - Anchors in the order they were added, none of which starts or
+/// ends within an earlier one in either stream. Alongside them it keeps the
+/// positions they cover in each stream, as disjoint intervals ordered by
+/// their start, so that a new anchor is checked against all earlier ones in
+/// logarithmic time.
+template <typename Index>
+class AnchorSet {
+  typedef BasicAnchor<Index> Anchor;
+  typedef std::map<Index, Index> Coverage;
+
+  std::vector<Anchor> list;
+
+  /// The union of the anchors' [start, start + length) in either stream,
+  /// mapping the start of every interval to its end.
+  Coverage sourceCoverage, targetCoverage;
+public:
+  /// anchors - Returns the anchors in the order they were added.
+  const std::vector<Anchor> &anchors() const { return list; }
+  std::vector<Anchor> &anchors() { return list; }
+
+  /// isMaximal - Returns true if neither the start nor the end of anch lies
+  /// within an anchor of the set, in the source or in the target.
+  bool isMaximal(const Anchor &anch) const {
+    const Index source = anch.sourceIdx(), target = anch.targetIdx();
+    return !covers(sourceCoverage, source) &&
+           !covers(sourceCoverage, source + anch.length()) &&
+           !covers(targetCoverage, target) &&
+           !covers(targetCoverage, target + anch.length());
+  }
+
+  /// insert - Add anch to the set if it is maximal. Returns true if it was
+  /// added.
+  bool insert(const Anchor &anch) {
+    if (!isMaximal(anch))
+      return false;
+    list.push_back(anch);
+    cover(sourceCoverage, anch.sourceIdx(), anch.sourceIdx() + anch.length());
+    cover(targetCoverage, anch.targetIdx(), anch.targetIdx() + anch.length());
+    return true;
+  }
+
+private:
+  /// covers - Returns true if position p lies within an interval of c.
+  static bool covers(const Coverage &c, Index p) {
+    typename Coverage::const_iterator i = c.upper_bound(p);
+    if (i == c.begin())
+      return false;
+    --i;
+    return p < i->second;
+  }
+
+  /// cover - Add [first, last) to c, merging it with the intervals it
+  /// overlaps or touches.
+  static void cover(Coverage &c, Index first, Index last) {
+    if (first >= last)
+      return;
+    typename Coverage::iterator i = c.upper_bound(first);
+    if (i != c.begin()) {
+      --i;
+      if (i->second < first)
+        ++i;
+      else
+        first = i->first;
+    }
+    while (i != c.end() && i->first <= last) {
+      last = std::max(last, i->second);
+      c.erase(i++);
+    }
+    c[first] = last;
+  }
+};
+
+#endif // ANCHORSET_H
@@ -0,0 +1,119 @@
+//===--- CloneAnalysis.cpp ------------------------------------------------===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the CloneAnalysis interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CloneAnalysis.h"
+#include "SuffixArray.h"
+#include "Token.h"
+
+#include <algorithm>
+
+namespace {
+
+/// Interval - An lcp-interval of the suffix array: the suffixes from rank lb
+/// on that share a prefix of lcp tokens, and what precedes them in the text.
+template <typename Index>
+struct Interval {
+  Index lcp, lb, left;
+};
+
+} // end anonymous namespace
+
+/// NoLeft, DiverseLeft - An interval whose suffixes are not yet known to be
+/// preceded by anything, and one whose suffixes are preceded by different
+/// tokens, or by the start of a stream.
+static const int NoLeft = -2;
+static const int DiverseLeft = -1;
+
+/// mergeLeft - Returns what precedes the suffixes of two sets together.
+template <typename Index>
+static inline Index mergeLeft(Index a, Index b) {
+  if (a == NoLeft)
+    return b;
+  if (b == NoLeft || a == b)
+    return a;
+  return DiverseLeft;
+}
+
+/// byLength - Orders clones longest first, and clones of equal length by
+/// their first occurrence.
+template <typename Index>
+static bool byLength(const BasicClone<Index> &a, const BasicClone<Index> &b) {
+  return a.length > b.length ||
+         (a.length == b.length && a.occurrences.front() < b.occurrences.front());
+}
+
+template <typename Index>
+std::vector<BasicClone<Index> > BasicCloneAnalysis<Index>::findClones(
+    const std::vector<TokenRange> &tokenStreams, Index minLength) {
+  // Stream k starts at starts[k] and is followed by sentinel k.
+  const Index nStreams = tokenStreams.size();
+  std::vector<Index> text, starts(1, 0);
+  for (Index k = 0; k < nStreams; ++k) {
+    const TokenRange tokStream = tokenStreams[k];
+    for (size_t j = 0; j < tokStream.size(); ++j)
+      text.push_back(tokStream[j].getHashValue());
+    text.push_back(k);
+    starts.push_back(text.size());
+  }
+  const BasicSuffixArray<Index> sa(text, construction);
+  const std::vector<Index> &indexPoints = sa.orderedIndexPoints();
+  const std::vector<Index> &LCPs = sa.LCPs();
+
+  // The suffixes sharing a prefix form an lcp-interval of the suffix array,
+  // and the prefix is a repeat that cannot be extended to the right. It is
+  // maximal if its occurrences are not all preceded by the same token
+  // either. Visit the intervals bottom up with a stack of the ones still
+  // open (Abouelhoda, Kurtz and Ohlebusch), passing what precedes the
+  // suffixes of each interval on to the interval enclosing it.
+  std::vector<Clone> clones;
+  std::vector<Interval<Index> > open;
+  const Interval<Index> root = { 0, 0, NoLeft };
+  open.push_back(root);
+  for (Index i = 1, n = indexPoints.size(); i <= n; ++i) {
+    const Index lcp = (i < n) ? LCPs[i] : 0;
+    const Index p = indexPoints[i - 1];
+    const Index left = (p == 0 || text[p - 1] < nStreams) ?
+                       (Index)DiverseLeft : text[p - 1];
+    open.back().left = mergeLeft(open.back().left, left);
+
+    Index lb = i - 1, carried = left;
+    while (lcp < open.back().lcp) {
+      const Interval<Index> interval = open.back();
+      open.pop_back();
+      if (interval.lcp >= minLength && interval.left == DiverseLeft) {
+        Clone clone;
+        clone.length = interval.lcp;
+        for (Index r = interval.lb; r < i; ++r) {
+          const Index x = indexPoints[r];
+          const Index k = std::upper_bound(starts.begin(), starts.end(), x) -
+                          starts.begin() - 1;
+          clone.occurrences.push_back(std::make_pair(k, x - starts[k]));
+        }
+        std::sort(clone.occurrences.begin(), clone.occurrences.end());
+        clones.push_back(clone);
+      }
+      lb = interval.lb;
+      if (lcp <= open.back().lcp)
+        open.back().left = mergeLeft(open.back().left, interval.left);
+      else
+        carried = interval.left;
+    }
+    if (lcp > open.back().lcp) {
+      const Interval<Index> interval = { lcp, lb, carried };
+      open.push_back(interval);
+    }
+  }
+
+  std::sort(clones.begin(), clones.end(), byLength<Index>);
+  return clones;
+}
+
+template class BasicCloneAnalysis<int>;
+template class BasicCloneAnalysis<int64_t>;
@@ -0,0 +1,61 @@
+//===--- CloneAnalysis.h - Repeated runs of tokens ------------*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines the CloneAnalysis interface.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef CLONEANALYSIS_H
+#define CLONEANALYSIS_H
+
+#include "SuffixArray.h"
+#include <utility>
+#include <vector>
+
+class Token;
+
+/// BasicClone - A run of tokens that occurs at several places in a set of
+/// token streams, each given by the number of its stream and its offset
+/// there.
+template <typename Index>
+struct BasicClone {
+  Index length;
+  std::vector<std::pair<Index, Index> > occurrences;
+};
+
+/// BasicCloneAnalysis - Finds the runs of tokens repeated within and across
+/// token streams with one generalized BasicSuffixArray of all of them.
+template <typename Index>
+class BasicCloneAnalysis {
+  typedef BasicClone<Index> Clone;
+
+  /// The algorithm used to build suffix arrays.
+  SuffixArrayBase::Construction construction;
+public:
+  explicit BasicCloneAnalysis(SuffixArrayBase::Construction algorithm =
+                                SuffixArrayBase::AutomaticConstruction)
+    : construction(algorithm) {}
+
+  /// findClones - Identify the maximal repeats of at least minLength tokens
+  /// in the token streams: runs that occur at least twice and cannot be
+  /// extended to either side at all of their occurrences at once. Streams
+  /// are separated by sentinels, so the ids of their tokens must leave room
+  /// for one per stream. The clones are returned longest first, with their
+  /// occurrences in stream order. Takes time linear in the number of tokens
+  /// and occurrences reported.
+  std::vector<Clone> findClones(
+      const std::vector<TokenRange> &tokenStreams, Index minLength);
+};
+
+/// Clone, CloneAnalysis - The default, 32-bit clone analysis.
+typedef BasicClone<int> Clone;
+typedef BasicCloneAnalysis<int> CloneAnalysis;
+
+/// Clone64, CloneAnalysis64 - Clone analysis of more than 2^31 tokens.
+typedef BasicClone<int64_t> Clone64;
+typedef BasicCloneAnalysis<int64_t> CloneAnalysis64;
+
+#endif // CLONEANALYSIS_H
@@ -18,8 +18,8 @@
 #include <iostream>
 
 std::list<DiffBlock> DiffAlgorithm::computeDifference(
-    const std::vector<Token> &sourceTokenStream, 
-    const std::vector<Token> &targetTokenStream) {
+    TokenRange sourceTokenStream, 
+    TokenRange targetTokenStream) {
   // Create two temporary files from the token data. Tokens are interspersed 
   // with newline characters yielding diff to operate with token granularity.
   // We use the mkstemp() function which generates a unique temporary filename 
@@ -31,7 +31,7 @@ std::list<DiffBlock> DiffAlgorithm::computeDifference(
   // O_EXCL flag, we need to first close the file before calling popen.
   std::string tmpfile[2];
   for (int i = 0; i < 2; ++i) {
-    std::vector<Token> tokenStream = (i==0) ? sourceTokenStream : targetTokenStream;
+    const TokenRange tokenStream = (i==0) ? sourceTokenStream : targetTokenStream;
     char tmpname[] = "/tmp/ndiff.XXXXXX";
     FILE *fpt = fdopen(mkstemp(tmpname), "w");
     tmpfile[i] = tmpname;
@@ -84,15 +84,17 @@ std::list<DiffBlock> DiffAlgorithm::computeDifference(
 
 std::list<DiffBlock> DiffAlgorithm::captureEqualities(
       const std::list<DiffBlock> &DBs,
-      const std::vector<Token> &sourceTokenStream, 
-      const std::vector<Token> &targetTokenStream) {
+      TokenRange sourceTokenStream, 
+      TokenRange targetTokenStream) {
   // Pointers into the source and target token streams that help us identify 
   // the equalities we failed to capture during the diff algorithm. At any given
   // time during the execution of this method, the pointers are at the start of
   // a pure delete, a pure insert, or a sequence of common tokens we need
-  // capture followed by a deletion or insertion.
-  std::vector<Token>::const_iterator srcStreamPtr(sourceTokenStream.begin());
-  std::vector<Token>::const_iterator tgtStreamPtr(targetTokenStream.begin());
+  // capture followed by a deletion or insertion. The pointers may run past the
+  // end of the ranges, into the tokens that follow them in their streams, but
+  // are never dereferenced past the end of those streams.
+  TokenRange::const_iterator srcStreamPtr(sourceTokenStream.begin());
+  TokenRange::const_iterator tgtStreamPtr(targetTokenStream.begin());
 
   std::list<DiffBlock> result; // Results go here.
   std::list<DiffBlock>::const_iterator i(DBs.begin()), e(DBs.end());
@@ -103,7 +105,8 @@ std::list<DiffBlock> DiffAlgorithm::captureEqualities(
     // If the current DiffBlock represents deleted tokens and the srcStreamPtr
     // is at the start of these tokens, we have a pure delete. That is, there
     // are no common tokens we need to capture.
-    if (DB.getOperation() == DELETE && 
+    if (DB.getOperation() == DELETE &&
+        srcStreamPtr < sourceTokenStream.streamEnd() &&
         DB.getTokens().front() == *srcStreamPtr) {
       result.push_back(DB);
       srcStreamPtr += DB.getTokens().size();
@@ -113,7 +116,8 @@ std::list<DiffBlock> DiffAlgorithm::captureEqualities(
     // If the current DiffBlock represents inserted tokens and the tgtStreamPtr
     // is at the start of these tokens, we have a pure insertion. That is, there
     // are no common tokens we need to capture.
-    if (DB.getOperation() == INSERT && 
+    if (DB.getOperation() == INSERT &&
+        tgtStreamPtr < targetTokenStream.streamEnd() &&
         DB.getTokens().front() == *tgtStreamPtr) {
       result.push_back(DB);
       tgtStreamPtr += DB.getTokens().size();
@@ -124,15 +128,15 @@ std::list<DiffBlock> DiffAlgorithm::captureEqualities(
     // need to capture and create a new DiffBlock for. Both the source and
     // target stream pointers point to the start of the equality and it runs
     // until we reach the begining of the current DiffBlock. Walk this run.
-    std::vector<Token> equality; 
+    const TokenRange::const_iterator equality(srcStreamPtr);
     while (srcStreamPtr < sourceTokenStream.end() &&
            tgtStreamPtr < targetTokenStream.end() &&
            *srcStreamPtr < DB.getTokens().front()) {
-      equality.push_back(*srcStreamPtr);
       ++srcStreamPtr;
       ++tgtStreamPtr;
     }
-    result.push_back(DiffBlock(EQUAL, equality));
+    result.push_back(DiffBlock(EQUAL, 
+                               TokenRange(equality, srcStreamPtr - equality)));
 
     // Add the current DiffBlock and increment the appropirate stream pointer.
     if (DB.getOperation() == DELETE) 
@@ -146,34 +150,30 @@ std::list<DiffBlock> DiffAlgorithm::captureEqualities(
 }
 
 void DiffAlgorithm::processDiff(const std::string &changecmd, 
-                                const std::vector<Token> &sourceTokenStream, 
-                                const std::vector<Token> &targetTokenStream, 
+                                TokenRange sourceTokenStream, 
+                                TokenRange targetTokenStream, 
                                 std::list<DiffBlock> &DBs) {
   int ranges[2][2];
   Operation op = processDiffControl(changecmd, ranges);
-  std::vector<Token> deleted, inserted;
 
+  // Ranges are of lines, numbered from 1 and inclusive. The range of the 
+  // other file in an insertion or deletion only tells where it happens.
   switch (op) {
     case DELETE: {
-      for (int i = ranges[0][0] - 1; i < ranges[0][1]; ++i) 
-        deleted.push_back(sourceTokenStream[i]);
-      DBs.push_back(DiffBlock(DELETE, deleted));
+      DBs.push_back(DiffBlock(DELETE, sourceTokenStream.slice(
+          ranges[0][0] - 1, ranges[0][1] - ranges[0][0] + 1)));
       return;
     }
     case INSERT: {
-      for (int i = ranges[1][0] - 1; i < ranges[1][1]; ++i) 
-        inserted.push_back(targetTokenStream[i]);
-      DBs.push_back(DiffBlock(INSERT, inserted));
+      DBs.push_back(DiffBlock(INSERT, targetTokenStream.slice(
+          ranges[1][0] - 1, ranges[1][1] - ranges[1][0] + 1)));
       return;
     }    
     case SUBST: {
-      for (int i = ranges[0][0] - 1; i < ranges[0][1]; ++i) 
-        deleted.push_back(sourceTokenStream[i]);
-      DBs.push_back(DiffBlock(DELETE, deleted));
-
-      for (int i = ranges[1][0] - 1; i < ranges[1][1]; ++i) 
-        inserted.push_back(targetTokenStream[i]);
-      DBs.push_back(DiffBlock(INSERT, inserted));
+      DBs.push_back(DiffBlock(DELETE, sourceTokenStream.slice(
+          ranges[0][0] - 1, ranges[0][1] - ranges[0][0] + 1)));
+      DBs.push_back(DiffBlock(INSERT, targetTokenStream.slice(
+          ranges[1][0] - 1, ranges[1][1] - ranges[1][0] + 1)));
       return;
     }
     default:
@@ -24,8 +24,8 @@ public:
   /// Creates two temporary files where each line of the file holds one token. 
   /// When then execute the diff command with the popen function and parse the 
   /// results.
-  std::list<DiffBlock> computeDifference(const std::vector<Token> &sourceTokenStream, 
-                                         const std::vector<Token> &targetTokenStream);
+  std::list<DiffBlock> computeDifference(TokenRange sourceTokenStream, 
+                                         TokenRange targetTokenStream);
 
   /// captureEqualities - The DiffBlocks returned by diff only represent the
   /// changes (insertions and deltions) that occured in the sourceTokenStream
@@ -33,13 +33,13 @@ public:
   /// and captures the missing equalities to provide a more complete result.
   std::list<DiffBlock> captureEqualities(
       const std::list<DiffBlock> &DBs,
-      const std::vector<Token> &sourceTokenStream, 
-      const std::vector<Token> &targetTokenStream);
+      TokenRange sourceTokenStream, 
+      TokenRange targetTokenStream);
 private:
   /// Parse diffs.
   void processDiff(const std::string &changecmd, 
-                   const std::vector<Token> &sourceTokenStream, 
-                   const std::vector<Token> &targetTokenStream, 
+                   TokenRange sourceTokenStream, 
+                   TokenRange targetTokenStream, 
                    std::list<DiffBlock> &DBs);
 
   /// Parse a normal format diff control string.  Return the type of the
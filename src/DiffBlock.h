@@ -13,6 +13,7 @@
 #define DIFFBLOCK_H
 #include <vector>
 #include "Token.h"
+#include "TokenRange.h"
 
 //class Token;
 
@@ -22,19 +23,36 @@ enum Operation {
   DELETE, // Deletes only: lines taken from just the first file.
   INSERT, // Inserts only: lines taken from just the second file.
   EQUAL, // No changes: lines common to both files.
-  SUBST
+  SUBST,
+  MOVE // Lines of the first file found elsewhere in the second one.
 };
 
 /// Class representing one DiffBlock.
 class DiffBlock {
   Operation operation;
   std::vector<Token> tokenVec;
+
+  /// The tokens of a MOVE in the second file.
+  std::vector<Token> destinationVec;
 public:
   /// DiffBlock constructor - Create a new DiffBlock object.
-  DiffBlock(Operation op, std::vector<Token> tokVec)
+  DiffBlock(Operation op, const std::vector<Token> &tokVec)
     : operation(op), tokenVec(tokVec) {
   }
 
+  /// DiffBlock constructor - Create a new DiffBlock object of the tokens of
+  /// a range, the only copy made of them.
+  DiffBlock(Operation op, TokenRange toks)
+    : operation(op), tokenVec(toks.begin(), toks.end()) {
+  }
+
+  /// DiffBlock constructor - Create a MOVE of the tokens toks of the first
+  /// file to dest in the second.
+  DiffBlock(TokenRange toks, TokenRange dest)
+    : operation(MOVE), tokenVec(toks.begin(), toks.end()), 
+      destinationVec(dest.begin(), dest.end()) {
+  }
+
   bool operator==(const DiffBlock &rhs) const { 
     return operation == rhs.operation &&
            tokenVec == rhs.tokenVec; 
@@ -57,7 +75,10 @@ public:
 
   /// getTokens - Returns a read-only vector containing the tokens associated 
   /// with this diff block.
-  const std::vector<Token> getTokens() const { return tokenVec; }
+  const std::vector<Token> &getTokens() const { return tokenVec; }
+
+  /// getDestination - Returns the tokens a MOVE has in the second file.
+  const std::vector<Token> &getDestination() const { return destinationVec; }
 
   /// tokenVector - Returns the tokenVector.
   std::vector<Token>& tokens() { return tokenVec; }
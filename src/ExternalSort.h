@@ -0,0 +1,97 @@
+//===--- ExternalSort.h - Sorting files larger than memory ----*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines a merge sort of the records of a TempFile.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include "TempFile.h"
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+/// externalSort - Sort the records of type T in file in into out, using 
+/// about memory bytes of RAM. Runs that fit in memory are sorted in place in
+/// in, which is left holding them, and merged into out in a single pass.
+/// Every run gets a read buffer of its share of memory, but at least 64 KB,
+/// so inputs of more than memory² / 64 KB bytes take more than memory. The
+/// sort is not stable. Returns false if a file operation failed.
+template <typename T, typename Compare>
+bool externalSort(TempFile &in, TempFile &out, size_t memory, Compare less) {
+  if (!in.flush())
+    return false;
+  out.clear();
+  const uint64_t n = in.size() / sizeof(T);
+  const uint64_t runLength = std::max<uint64_t>(1, memory / sizeof(T));
+
+  // Everything fits: sort it in one go.
+  std::vector<T> records;
+  if (n <= runLength) {
+    records.resize(n);
+    TempFile::Reader<T> reader(in);
+    for (uint64_t i = 0; i < n; ++i)
+      reader.next(records[i]);
+    std::sort(records.begin(), records.end(), less);
+    out.append(n ? &records[0] : 0, n);
+    return out.flush();
+  }
+
+  // Sort runs in place.
+  const uint64_t nRuns = (n + runLength - 1) / runLength;
+  for (uint64_t r = 0; r < nRuns; ++r) {
+    const uint64_t first = r * runLength, 
+                   count = std::min(runLength, n - first);
+    records.resize(count);
+    TempFile::Reader<T> reader(in, first, count);
+    for (uint64_t i = 0; i < count; ++i)
+      reader.next(records[i]);
+    std::sort(records.begin(), records.end(), less);
+    in.overwrite(&records[0], count, first);
+  }
+  std::vector<T>().swap(records);
+  if (!in.isOpen())
+    return false;
+
+  // Merge them, smallest head first. The queue orders by greater, with 
+  // ties broken by run so that the order does not depend on the heap.
+  typedef std::pair<T, uint64_t> Head;
+  struct Greater {
+    Compare less;
+    explicit Greater(Compare l) : less(l) {}
+    bool operator()(const Head &a, const Head &b) const {
+      if (less(b.first, a.first)) return true;
+      if (less(a.first, b.first)) return false;
+      return b.second < a.second;
+    }
+  };
+  const size_t bufferSize = std::max<size_t>(64 << 10, memory / (nRuns + 1));
+  std::vector<TempFile::Reader<T> > readers;
+  readers.reserve(nRuns);
+  std::priority_queue<Head, std::vector<Head>, Greater> heads((Greater(less)));
+  for (uint64_t r = 0; r < nRuns; ++r) {
+    const uint64_t first = r * runLength;
+    readers.push_back(TempFile::Reader<T>(in, first, 
+                                          std::min(runLength, n - first), 
+                                          bufferSize));
+    T record;
+    if (readers.back().next(record))
+      heads.push(Head(record, r));
+  }
+  while (!heads.empty()) {
+    const Head head = heads.top();
+    heads.pop();
+    out.append(head.first);
+    T record;
+    if (readers[head.second].next(record))
+      heads.push(Head(record, head.second));
+  }
+  return out.flush();
+}
+
+#endif // EXTERNALSORT_H
@@ -0,0 +1,184 @@
+//===--- ExternalSuffixArray.cpp - Disk-based suffix array ----------------===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the ExternalSuffixArray interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ExternalSuffixArray.h"
+#include "ExternalSort.h"
+#include "Token.h"
+#include "TokenText.h"
+
+namespace {
+
+/// Named - A suffix and its name, the rank of its first tokens.
+template <typename Index>
+struct Named {
+  Index pos, name;
+  static bool byPosition(const Named &a, const Named &b) {
+    return a.pos < b.pos;
+  }
+};
+
+/// Tuple - A suffix with its name and the name of the suffix h tokens on.
+template <typename Index>
+struct Tuple {
+  Index name, next, pos;
+  static bool byNames(const Tuple &a, const Tuple &b) {
+    return a.name < b.name || (a.name == b.name && a.next < b.next);
+  }
+};
+
+/// PhiEntry - A suffix, its rank and the suffix ranked before it.
+template <typename Index>
+struct PhiEntry {
+  Index pos, previous, rank;
+  static bool byPosition(const PhiEntry &a, const PhiEntry &b) {
+    return a.pos < b.pos;
+  }
+};
+
+/// RankedLCP - The LCP of the suffix of a rank.
+template <typename Index>
+struct RankedLCP {
+  Index rank, lcp;
+  static bool byRank(const RankedLCP &a, const RankedLCP &b) {
+    return a.rank < b.rank;
+  }
+};
+
+} // end anonymous namespace
+
+template <typename Index>
+bool BasicExternalSuffixArray<Index>::init(TokenRange sourceTokenStream,
+                                           TokenRange targetTokenStream) {
+  const TokenText<Index> text(sourceTokenStream, targetTokenStream);
+  return sortSuffixes(text) && computeLCPs(text);
+}
+
+template <typename Index>
+template <typename Text>
+bool BasicExternalSuffixArray<Index>::sortSuffixes(const Text &text) {
+  typedef ::Named<Index> Named;
+  typedef ::Tuple<Index> Tuple;
+  const Index n = text.size;
+  TempFile names(dir, stats), tuples(dir, stats), sorted(dir, stats);
+
+  // The tokens name the suffixes by their first token.
+  for (Index p = 0; p < n; ++p) {
+    const Named named = { p, text[p] };
+    names.append(named);
+  }
+  if (!names.flush())
+    return false;
+
+  for (Index h = 1;; h *= 2) {
+    // Pair every name with the one h tokens on. Both are read sequentially,
+    // h records apart. Suffixes that end within h tokens have reached their
+    // sentinel, so their names are unique already.
+    tuples.clear();
+    {
+      TempFile::Reader<Named> at(names), ahead(names, h);
+      Named x, y;
+      for (Index p = 0; p < n && at.next(x); ++p) {
+        const Tuple tuple = { x.name, ahead.next(y) ? y.name : -1, p };
+        tuples.append(tuple);
+      }
+    }
+    if (!externalSort<Tuple>(tuples, sorted, memoryBudget, Tuple::byNames))
+      return false;
+
+    // Name the suffixes by the rank of the first with the same pair of 
+    // names, which orders them by their first 2h tokens.
+    names.clear();
+    Index groups = 0;
+    {
+      TempFile::Reader<Tuple> reader(sorted);
+      Tuple t, previous = { -1, -1, -1 };
+      for (Index r = 0; reader.next(t); ++r) {
+        if (r == 0 || Tuple::byNames(previous, t))
+          ++groups;
+        const Named named = { t.pos, groups - 1 };
+        names.append(named);
+        previous = t;
+      }
+    }
+
+    // Once every name is unique the sorted tuples are the suffix array.
+    if (groups == n) {
+      SA.clear();
+      TempFile::Reader<Tuple> reader(sorted);
+      Tuple t;
+      while (reader.next(t))
+        SA.append(t.pos);
+      return SA.flush();
+    }
+    if (!externalSort<Named>(names, tuples, memoryBudget, Named::byPosition))
+      return false;
+    names.swap(tuples);
+  }
+}
+
+template <typename Index>
+template <typename Text>
+bool BasicExternalSuffixArray<Index>::computeLCPs(const Text &text) {
+  typedef ::PhiEntry<Index> PhiEntry;
+  typedef ::RankedLCP<Index> RankedLCP;
+  const Index n = text.size;
+  TempFile entries(dir, stats), sorted(dir, stats);
+
+  // Phi maps every suffix to the one before it in the suffix array; bring 
+  // it into text order.
+  {
+    TempFile::Reader<Index> reader(SA);
+    Index x, previous = -1;
+    for (Index r = 0; reader.next(x); ++r) {
+      const PhiEntry entry = { x, previous, r };
+      entries.append(entry);
+      previous = x;
+    }
+  }
+  if (!externalSort<PhiEntry>(entries, sorted, memoryBudget, 
+                              PhiEntry::byPosition))
+    return false;
+
+  // In text order the LCP drops by at most one from one suffix to the next,
+  // which bounds the comparisons by 2n. The distinct sentinels stop every 
+  // comparison before the end of the text.
+  entries.clear();
+  {
+    TempFile::Reader<PhiEntry> reader(sorted);
+    PhiEntry e;
+    Index h = 0;
+    while (reader.next(e)) {
+      if (e.previous < 0) {
+        h = 0;
+      } else {
+        while (e.pos + h < n && e.previous + h < n && 
+               text[e.pos + h] == text[e.previous + h])
+          ++h;
+      }
+      const RankedLCP ranked = { e.rank, h };
+      entries.append(ranked);
+      if (h > 0)
+        --h;
+    }
+  }
+  if (!externalSort<RankedLCP>(entries, sorted, memoryBudget, 
+                               RankedLCP::byRank))
+    return false;
+
+  LCP.clear();
+  TempFile::Reader<RankedLCP> reader(sorted);
+  RankedLCP ranked;
+  while (reader.next(ranked))
+    LCP.append(ranked.lcp);
+  return LCP.flush();
+}
+
+template class BasicExternalSuffixArray<int>;
+template class BasicExternalSuffixArray<int64_t>;
@@ -0,0 +1,98 @@
+//===--- ExternalSuffixArray.h - Disk-based suffix array ------*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines the ExternalSuffixArray interface.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef EXTERNALSUFFIXARRAY_H
+#define EXTERNALSUFFIXARRAY_H
+
+#include "TempFile.h"
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class Token;
+class TokenRange;
+
+/// BasicExternalSuffixArray - The suffix array and LCP array of two token 
+/// streams, built and stored in temporary files so that RAM use stays within
+/// a given budget however long the streams are. The result is the same as 
+/// that of a BasicSuffixArray of the streams, but it can only be read front
+/// to back.
+///
+/// The suffixes are sorted by prefix doubling with external merge sorts 
+/// (Dementiev, Karkkainen, Mehnert and Sanders, "Better External Memory 
+/// Suffix Array Construction", ACM JEA 12, 2008): every round names each 
+/// suffix by the rank of its first 2h tokens, until all names differ. That 
+/// takes about log2 of the longest repeat rounds of sequential I/O. The LCPs
+/// are computed with the Phi algorithm, which reads the tokens themselves at
+/// random and everything else sequentially.
+template <typename Index>
+class BasicExternalSuffixArray {
+  /// Where the temporary files are created.
+  std::string dir;
+
+  /// Approximate number of bytes of RAM to use for sorting.
+  size_t memoryBudget;
+
+  /// The I/O volume of all temporary files.
+  TempFile::Statistics stats;
+
+  /// The index points in suffix order and the LCPs of neighbouring suffixes.
+  TempFile SA, LCP;
+
+  BasicExternalSuffixArray(const BasicExternalSuffixArray &); // Do not implement.
+  BasicExternalSuffixArray &operator=(const BasicExternalSuffixArray &); // Do not implement.
+public:
+  /// BasicExternalSuffixArray constructor - Keep the arrays in directory and
+  /// sort with about memory bytes of RAM.
+  BasicExternalSuffixArray(const std::string &directory, size_t memory)
+    : dir(directory), memoryBudget(memory), SA(directory, stats), 
+      LCP(directory, stats) {}
+
+  /// init - Build the arrays of the two token streams, each followed by a 
+  /// sentinel as in BasicSuffixArray. Returns false if a temporary file 
+  /// could not be created or written.
+  bool init(TokenRange sourceTokenStream, TokenRange targetTokenStream);
+
+  /// orderedIndexPoints - Returns the file of index points in suffix order.
+  const TempFile &orderedIndexPoints() const { return SA; }
+
+  /// LCPs - Returns the file of LCPs of each suffix and the one before it.
+  const TempFile &LCPs() const { return LCP; }
+
+  /// directory - Returns the directory of the temporary files.
+  const std::string &directory() const { return dir; }
+
+  /// memory - Returns the RAM budget in bytes.
+  size_t memory() const { return memoryBudget; }
+
+  /// statistics - Returns the I/O volume so far. Further temporary files in
+  /// directory can count theirs here as well.
+  TempFile::Statistics &statistics() { return stats; }
+
+private:
+  /// sortSuffixes - Sort the suffixes of text by prefix doubling and store 
+  /// them in SA.
+  template <typename Text>
+  bool sortSuffixes(const Text &text);
+
+  /// computeLCPs - Compute the LCPs of the suffixes in SA and store them in
+  /// LCP.
+  template <typename Text>
+  bool computeLCPs(const Text &text);
+};
+
+/// ExternalSuffixArray - The default, 32-bit external suffix array.
+typedef BasicExternalSuffixArray<int> ExternalSuffixArray;
+
+/// ExternalSuffixArray64 - External suffix array of more than 2^31 tokens.
+typedef BasicExternalSuffixArray<int64_t> ExternalSuffixArray64;
+
+#endif // EXTERNALSUFFIXARRAY_H
@@ -103,6 +103,9 @@ void LosslessOptimizer::mergeCoincidentalEqualities(std::list<DiffBlock> &DBs) {
         inserted.insert(inserted.end(), toks.begin(), toks.end());
         prevEqual = end;
         break;
+      // Moves are only split out by NDiff::extractMoves, after this runs. A 
+      // MOVE would separate the edits around it just as an equality does.
+      case MOVE:
       case EQUAL:
         if (deleteCount + insertCount > 1) {
           bool bothTypes = (deleteCount != 0) && (insertCount != 0);
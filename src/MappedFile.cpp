@@ -0,0 +1,66 @@
+//===--- MappedFile.cpp - Read-only memory mapped file --------------------===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the MappedFile interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MappedFile.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MappedFile::open(const std::string &path) {
+  close();
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+
+  // mmap refuses zero length mappings, so an empty file is simply an open
+  // MappedFile without any data.
+  len = st.st_size;
+  if (len > 0) {
+    void *addr = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      len = 0;
+      return false;
+    }
+    // We read the mapping front to back exactly once in the common case.
+    madvise(addr, len, MADV_SEQUENTIAL);
+    base = static_cast<const char *>(addr);
+  }
+  ::close(fd);
+  opened = true;
+  return true;
+}
+
+void MappedFile::close() {
+  if (base)
+    munmap(const_cast<char *>(base), len);
+  base = 0;
+  len = 0;
+  opened = false;
+}
+
+bool MappedFile::identical(const std::string &path0, const std::string &path1) {
+  MappedFile f0(path0), f1(path1);
+  if (!f0.isOpen() || !f1.isOpen())
+    return false;
+  if (f0.size() != f1.size())
+    return false;
+  // The C library's memcmp is vectorized and stops at the first difference.
+  return f0.size() == 0 || memcmp(f0.data(), f1.data(), f0.size()) == 0;
+}
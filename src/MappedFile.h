@@ -0,0 +1,65 @@
+//===--- MappedFile.h - Read-only memory mapped file ----------*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines the MappedFile interface.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+/// MappedFile - A read-only view of a file's contents mapped into memory with
+/// mmap. The mapping lives as long as the MappedFile object.
+class MappedFile {
+  /// Start of the mapping, or null when the file is empty or not open.
+  const char *base;
+
+  /// Number of bytes in the file.
+  size_t len;
+
+  /// True when the file was opened successfully.
+  bool opened;
+
+  MappedFile(const MappedFile &);            // Do not implement.
+  MappedFile &operator=(const MappedFile &); // Do not implement.
+public:
+  /// MappedFile constructor - Create a MappedFile not yet bound to a file.
+  MappedFile() : base(0), len(0), opened(false) {}
+
+  /// MappedFile constructor - Create a MappedFile and map the file at path.
+  explicit MappedFile(const std::string &path)
+    : base(0), len(0), opened(false) {
+    open(path);
+  }
+
+  ~MappedFile() { close(); }
+
+  /// open - Map the file at path into memory. Returns false if the file could
+  /// not be opened or mapped.
+  bool open(const std::string &path);
+
+  /// close - Release the mapping, if any.
+  void close();
+
+  /// isOpen - Returns true if a file is currently mapped.
+  bool isOpen() const { return opened; }
+
+  /// data - Returns a pointer to the first byte of the file.
+  const char *data() const { return base; }
+
+  /// size - Returns the number of bytes in the file.
+  size_t size() const { return len; }
+
+  /// identical - Returns true if both files could be mapped and their contents
+  /// are byte-for-byte identical. The sizes are compared before any data is
+  /// touched.
+  static bool identical(const std::string &path0, const std::string &path1);
+};
+
+#endif // MAPPEDFILE_H
@@ -10,25 +10,391 @@
 
 #include "Anchor.h"
 #include "AnchorAnalysis.h"
+#include "CloneAnalysis.h"
 #include "DiffAlgorithm.h"
 #include "DiffBlock.h"
+#include "ExternalSuffixArray.h"
 #include "LosslessOptimizer.h"
+#include "MappedFile.h"
 #include "NDiff.h"
+#include "Parallel.h"
+#include "ReferenceIndex.h"
 #include "TokenLexer.h"
 #include "Token.h"
+#include <algorithm>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <map>
+#include <sys/stat.h>
 
-// Main Driver
+/// DefaultSparseSampling - The rate at which --sparse samples suffixes 
+/// within a line.
+static const int DefaultSparseSampling = 8;
+
+/// DefaultMinimizerLength, DefaultMinimizerWindow - The k-mer length and 
+/// window of --minimizers.
+static const int DefaultMinimizerLength = 8;
+static const int DefaultMinimizerWindow = 8;
+
+/// MinimizerThreshold - Files of at least this many tokens together are 
+/// compared with minimizer seeds unless another method was asked for; their
+/// suffix array would take gigabytes.
+static const int64_t MinimizerThreshold = (int64_t)1 << 26;
+
+/// SmallPairBytes - Pairs of files of at most this many bytes together are
+/// batched by --batch.
+static const off_t SmallPairBytes = 64 << 10;
+
+/// BatchPairs - The most pairs --batch sorts with one suffix array.
+static const int BatchPairs = 256;
+
+/// MaxDirectGap - Gaps between anchors of at most this many tokens on 
+/// either side are compared without running diff when they share no token,
+/// and so are gaps empty on one side.
+static const size_t MaxDirectGap = 4;
+
+/// IdBlock - The number of token ids commonPrefix and commonSuffix compare
+/// at once. One block is a cache line, which memcmp compares in a few wide
+/// loads.
+static const int64_t IdBlock = 16;
+
+/// DefaultCloneLength - The fewest tokens ndiff --clones reports a run of.
+static const int DefaultCloneLength = 50;
+
+/// DefaultExternalMemory - The RAM budget of --external, in MB.
+static const int DefaultExternalMemory = 64;
+
+static void usage() {
+  fprintf(stderr, "usage: ndiff [-q | --brief] [--sa=dc3|sais|parallel] "
+                  "[--gap-anchors=n] [--moves]\n"
+                  "             [--mismatches=k]\n"
+                  "             [--sparse[=k] | --minimizers[=k,w] | "
+                  "--index=file |\n"
+                  "              --external[=dir] [--external-memory=MB]] "
+                  "source target\n"
+                  "       ndiff [-q | --brief] [--sa=dc3|sais|parallel] "
+                  "source target...\n"
+                  "       ndiff [-q | --brief] [--sa=dc3|sais|parallel] "
+                  "--batch=file\n"
+                  "       ndiff [-q | --brief] [--sa=dc3|sais|parallel] "
+                  "-r dir1 dir2\n"
+                  "       ndiff --write-index=file reference\n"
+                  "       ndiff --clones [--min-tokens=n] file...\n");
+}
+
+/// readable - Returns true if the file at path can be read. If not, says why
+/// on stderr the way diff does.
+static bool readable(const std::string &path) {
+  errno = 0;
+  MappedFile file(path);
+  if (file.isOpen())
+    return true;
+  fprintf(stderr, "ndiff: %s: %s\n", path.c_str(), 
+          errno ? strerror(errno) : "Not a regular file");
+  return false;
+}
+
+/// readPairs - Read the pairs of files named by the lines of the file at 
+/// path, or of stdin for "-": a source and a target path separated by 
+/// whitespace. Returns false if the file cannot be read or a line is not a 
+/// pair.
+static bool readPairs(const std::string &path, 
+                      std::vector<std::pair<std::string, std::string> > &pairs) {
+  FILE *in = (path == "-") ? stdin : fopen(path.c_str(), "r");
+  if (!in)
+    return false;
+  char line[8192], source[4096], target[4096], rest[2];
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), in)) {
+    const int fields = sscanf(line, "%4095s %4095s %1s", source, target, rest);
+    if (fields == 2)
+      pairs.push_back(std::make_pair(std::string(source), std::string(target)));
+    else
+      ok = (fields == EOF);
+  }
+  ok = ok && !ferror(in);
+  if (in != stdin)
+    fclose(in);
+  return ok;
+}
+
+/// listFiles - Add the regular files under the directory root/dir to 
+/// files, by their path relative to root, with their size. Symbolic links 
+/// to files are followed but links to directories are not, so that a link 
+/// cannot lead the walk in circles. Returns false if a directory cannot be
+/// read; the rest of the tree is still listed.
+static bool listFiles(const std::string &root, const std::string &dir,
+                      std::map<std::string, off_t> &files) {
+  const std::string path = dir.empty() ? root : root + "/" + dir;
+  DIR *d = opendir(path.c_str());
+  if (!d) {
+    fprintf(stderr, "ndiff: %s: cannot read directory\n", path.c_str());
+    return false;
+  }
+  bool ok = true;
+  while (struct dirent *entry = readdir(d)) {
+    const std::string name(entry->d_name);
+    if (name == "." || name == "..")
+      continue;
+    const std::string relative = dir.empty() ? name : dir + "/" + name;
+    const std::string entryPath = root + "/" + relative;
+    struct stat st;
+    if (lstat(entryPath.c_str(), &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode))
+      ok = listFiles(root, relative, files) && ok;
+    else if (S_ISLNK(st.st_mode) && stat(entryPath.c_str(), &st) != 0)
+      continue;
+    if (S_ISREG(st.st_mode))
+      files[relative] = st.st_size;
+  }
+  closedir(d);
+  return ok;
+}
+
+/// onlyIn - Print that the file at path relative to root has no counterpart
+/// in the other tree, in the words of diff -r.
+static void onlyIn(const std::string &root, const std::string &path) {
+  const std::string::size_type slash = path.rfind('/');
+  if (slash == std::string::npos)
+    printf("Only in %s: %s\n", root.c_str(), path.c_str());
+  else
+    printf("Only in %s/%s: %s\n", root.c_str(), path.substr(0, slash).c_str(),
+           path.c_str() + slash + 1);
+}
+
+// Main Driver. ndiff exits with 2 on trouble. Like diff -q and diff -r, the 
+// -q and -r modes exit with 1 when the files differ and 0 when they do not;
+// the other modes exit with 0 once the differences are printed.
 int main(int argc, char *argv[]) {
   NDiff ndiff;
+  bool brief = false, recursive = false, clones = false;
+  int64_t minLength = DefaultCloneLength;
+  std::string indexPath, writeIndexPath, externalDirectory, batchPath;
+  int externalMemory = DefaultExternalMemory;
+  int k, w;
+  int argi = 1;
+  for (; argi < argc && argv[argi][0] == '-'; ++argi) {
+    const std::string opt(argv[argi]);
+    if (opt == "--") {
+      ++argi;
+      break;
+    } else if (opt == "-q" || opt == "--brief") {
+      brief = true;
+    } else if (opt == "-r" || opt == "--recursive") {
+      recursive = true;
+    } else if (opt == "--sa=dc3") {
+      ndiff.setSuffixArrayConstruction(SuffixArray::DC3Construction);
+    } else if (opt == "--sa=sais") {
+      ndiff.setSuffixArrayConstruction(SuffixArray::SAISConstruction);
+    } else if (opt == "--sa=parallel") {
+      ndiff.setSuffixArrayConstruction(SuffixArray::ParallelConstruction);
+    } else if (opt == "--sparse") {
+      ndiff.setSparseSampling(DefaultSparseSampling);
+    } else if (opt.compare(0, 9, "--sparse=") == 0 && 
+               atoi(opt.c_str() + 9) > 0) {
+      ndiff.setSparseSampling(atoi(opt.c_str() + 9));
+    } else if (opt == "--minimizers") {
+      ndiff.setMinimizerSeeding(DefaultMinimizerLength, 
+                                DefaultMinimizerWindow);
+    } else if (opt.compare(0, 13, "--minimizers=") == 0 &&
+               sscanf(opt.c_str() + 13, "%d,%d", &k, &w) == 2 && 
+               k > 0 && w > 0) {
+      ndiff.setMinimizerSeeding(k, w);
+    } else if (opt == "--external") {
+      const char *tmpdir = getenv("TMPDIR");
+      externalDirectory = (tmpdir && *tmpdir) ? tmpdir : "/tmp";
+    } else if (opt.compare(0, 11, "--external=") == 0 && opt.size() > 11) {
+      externalDirectory = opt.substr(11);
+    } else if (opt.compare(0, 18, "--external-memory=") == 0 &&
+               atoi(opt.c_str() + 18) > 0) {
+      externalMemory = atoi(opt.c_str() + 18);
+    } else if (opt.compare(0, 14, "--gap-anchors=") == 0 && 
+               opt.size() > 14 && atoll(opt.c_str() + 14) >= 0) {
+      ndiff.setGapAnchoring(atoll(opt.c_str() + 14), 
+                            NDiff::DefaultAnchorDepth);
+    } else if (opt == "--moves") {
+      ndiff.setMoveDetection(true);
+    } else if (opt.compare(0, 13, "--mismatches=") == 0 && 
+               opt.size() > 13 && atoi(opt.c_str() + 13) >= 0) {
+      ndiff.setMismatches(atoi(opt.c_str() + 13));
+    } else if (opt.compare(0, 8, "--batch=") == 0 && opt.size() > 8) {
+      batchPath = opt.substr(8);
+    } else if (opt.compare(0, 8, "--index=") == 0) {
+      indexPath = opt.substr(8);
+    } else if (opt.compare(0, 14, "--write-index=") == 0 && opt.size() > 14) {
+      writeIndexPath = opt.substr(14);
+    } else if (opt == "--clones") {
+      clones = true;
+    } else if (opt.compare(0, 13, "--min-tokens=") == 0 &&
+               atoll(opt.c_str() + 13) > 0) {
+      minLength = atoll(opt.c_str() + 13);
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (!externalDirectory.empty())
+    ndiff.setExternalConstruction(externalDirectory, 
+                                  (size_t)externalMemory << 20);
+
+  // Clones are reported much like diff reports differences: the exit status
+  // is 1 if there are any, and 2 if a file could not be read.
+  if (clones) {
+    if (argi == argc || recursive || !batchPath.empty() || 
+        !indexPath.empty() || !writeIndexPath.empty()) {
+      usage();
+      return 2;
+    }
+    bool trouble = false;
+    std::vector<std::string> paths;
+    for (int i = argi; i < argc; ++i) {
+      if (readable(argv[i]))
+        paths.push_back(argv[i]);
+      else
+        trouble = true;
+    }
+    const size_t found = ndiff.reportClones(paths, minLength);
+    return trouble ? 2 : found > 0 ? 1 : 0;
+  }
+
+  // Writing an index compares nothing.
+  if (!writeIndexPath.empty()) {
+    if (argc - argi != 1 || recursive || !batchPath.empty() || 
+        !indexPath.empty()) {
+      usage();
+      return 2;
+    }
+    if (!readable(argv[argi]))
+      return 2;
+    if (!ndiff.writeIndex(argv[argi], writeIndexPath)) {
+      fprintf(stderr, "ndiff: cannot write index %s\n", writeIndexPath.c_str());
+      return 2;
+    }
+    return 0;
+  }
+
+  // A recursive comparison pairs the files of two directory trees by path.
+  if (recursive) {
+    if (argc - argi != 2 || !batchPath.empty() || !indexPath.empty()) {
+      usage();
+      return 2;
+    }
+    return ndiff.compareTrees(argv[argi], argv[argi + 1], brief);
+  }
+
+  // A batch takes its pairs from a file instead of the command line.
+  if (!batchPath.empty()) {
+    std::vector<std::pair<std::string, std::string> > pairs;
+    if (argc != argi || !indexPath.empty()) {
+      usage();
+      return 2;
+    }
+    if (!readPairs(batchPath, pairs)) {
+      fprintf(stderr, "ndiff: %s: cannot read pairs of files\n", 
+              batchPath.c_str());
+      return 2;
+    }
+
+    // A pair with a file that cannot be read is left out, and the others 
+    // are compared all the same.
+    bool trouble = false;
+    std::vector<std::pair<std::string, std::string> > readablePairs;
+    for (size_t p = 0; p < pairs.size(); ++p) {
+      const bool sourceReadable = readable(pairs[p].first);
+      if (readable(pairs[p].second) && sourceReadable)
+        readablePairs.push_back(pairs[p]);
+      else
+        trouble = true;
+    }
+    bool differ = false;
+    if (brief) {
+      for (size_t p = 0; p < readablePairs.size(); ++p) {
+        if (ndiff.filesDiffer(readablePairs[p].first, readablePairs[p].second)) {
+          printf("Files %s and %s differ\n", readablePairs[p].first.c_str(), 
+                 readablePairs[p].second.c_str());
+          differ = true;
+        }
+      }
+    } else {
+      ndiff.computeBatchDifferences(readablePairs);
+    }
+    return trouble ? 2 : differ ? 1 : 0;
+  }
+
+  if (argc - argi < 2 || (argc - argi > 2 && !indexPath.empty())) {
+    usage();
+    return 2;
+  }
+
+  // More than one target compares the source with each of them in turn.
+  if (argc - argi > 2) {
+    // A target that cannot be read is left out.
+    const std::string sourcePath(argv[argi]);
+    if (!readable(sourcePath))
+      return 2;
+    bool trouble = false;
+    std::vector<std::string> targetPaths;
+    for (int t = argi + 1; t < argc; ++t) {
+      if (readable(argv[t]))
+        targetPaths.push_back(argv[t]);
+      else
+        trouble = true;
+    }
+    bool differ = false;
+    if (brief) {
+      for (size_t t = 0; t < targetPaths.size(); ++t) {
+        if (ndiff.filesDiffer(sourcePath, targetPaths[t])) {
+          printf("Files %s and %s differ\n", sourcePath.c_str(), 
+                 targetPaths[t].c_str());
+          differ = true;
+        }
+      }
+    } else {
+      ndiff.computeDifferences(sourcePath, targetPaths);
+    }
+    return trouble ? 2 : differ ? 1 : 0;
+  }
+
+  // A file that cannot be read is trouble, not a difference.
+  const std::string sourcePath(argv[argi]), targetPath(argv[argi + 1]);
+  const bool sourceReadable = readable(sourcePath);
+  if (!readable(targetPath) || !sourceReadable)
+    return 2;
+  if (brief) {
+    // Report only whether the files differ, the way diff -q does.
+    if (!ndiff.filesDiffer(sourcePath, targetPath))
+      return 0;
+    printf("Files %s and %s differ\n", sourcePath.c_str(), targetPath.c_str());
+    return 1;
+  }
+
+  // The index has to stay mapped for as long as ndiff uses it.
+  ReferenceIndex index;
+  if (!indexPath.empty()) {
+    if (!index.open(indexPath)) {
+      fprintf(stderr, "ndiff: %s: not a valid index\n", indexPath.c_str());
+      return 2;
+    }
+    ndiff.setReferenceIndex(&index);
+  }
+
   std::list<DiffBlock> DBs;
-  DBs = ndiff.computeDifference(std::string(argv[1]), std::string(argv[2]));
+  DBs = ndiff.computeDifference(sourcePath, targetPath);
   return 0;
 }
 
 // This method is the driver for the ndiff comparison algorithm. 
 std::list<DiffBlock> NDiff::computeDifference(
     const std::string &sourcePath, const std::string &targetpath) {  
+  // Byte-identical files have nothing to report. Comparing the mapped files
+  // is far cheaper than lexing them, so check for this before anything else.
+  if (MappedFile::identical(sourcePath, targetpath))
+    return std::list<DiffBlock>();
+
   // The first step is to divide the files into meaningful units that 
   // we can operate on and compare against.
   TokenLexer theTokenLexer;
@@ -45,15 +411,363 @@ std::list<DiffBlock> NDiff::computeDifference(
   //
   // When we discard runs of tokens, we also mark them as EQUALS so that they 
   // can be considered in the output.
-  std::vector<Token> sourceTokenStream, targetTokenStream;
+  //
+  // Discard all white space, collecting the ids of the tokens left in the 
+  // same pass so that the common prefix and suffix are found by scanning 
+  // them. The tokens left are viewed by their positions in the lexed 
+  // streams, so none of them is copied.
+  std::vector<int64_t> sourcePositions, targetPositions;
+  std::vector<int> sourceTokenIds, targetTokenIds;
+  discardWhitespace(lexedSourceTokStream, sourcePositions, &sourceTokenIds);
+  discardWhitespace(lexedTargetTokStream, targetPositions, &targetTokenIds);
+  const TokenRange sourceTokenStream(lexedSourceTokStream, sourcePositions, 
+                                     sourceTokenIds);
+  const TokenRange targetTokenStream(lexedTargetTokStream, targetPositions, 
+                                     targetTokenIds);
 
-  // Discard all white space.
-  sourceTokenStream = discardWhitespace(lexedSourceTokStream);
-  targetTokenStream = discardWhitespace(lexedTargetTokStream);
-  
-  // Check for equality.
+  // A prebuilt index of the source gives the tokens ids of its own.
+  std::vector<int> targetIds;
+  const bool useIndex = referenceIndex && 
+    translateTokens(theTokenLexer, sourceTokenStream, targetTokenStream, 
+                    targetIds);
+  return compareTokenStreams<int>(lexedSourceTokStream, lexedTargetTokStream,
+                                  sourceTokenStream, targetTokenStream,
+                                  useIndex ? &targetIds : 0, 0, stdout);
+}
+
+std::vector<std::list<DiffBlock> > NDiff::computeDifferences(
+    const std::string &sourcePath, const std::vector<std::string> &targetPaths) {
+  const size_t nTargets = targetPaths.size();
+  std::vector<std::list<DiffBlock> > DBs(nTargets);
+
+  // Byte-identical targets have nothing to report and are left out of the
+  // suffix array.
+  std::vector<size_t> differing;
+  for (size_t t = 0; t < nTargets; ++t)
+    if (!MappedFile::identical(sourcePath, targetPaths[t]))
+      differing.push_back(t);
+  if (differing.empty())
+    return DBs;
+
+  // Lex every file with one lexer, so that equal tokens get equal ids in all
+  // of them, and leave an id below the tokens for each stream's sentinel. 
+  const size_t n = differing.size();
+  TokenLexer theTokenLexer(n + 1);
+  const std::vector<Token> lexedSourceTokStream(theTokenLexer.tokenize(sourcePath));
+  std::vector<int64_t> sourcePositions;
+  std::vector<int> sourceTokenIds;
+  discardWhitespace(lexedSourceTokStream, sourcePositions, &sourceTokenIds);
+  const TokenRange sourceTokenStream(lexedSourceTokStream, sourcePositions,
+                                     sourceTokenIds);
+  std::vector<std::vector<Token> > lexedTargetTokStreams(n);
+  std::vector<std::vector<int64_t> > targetPositions(n);
+  std::vector<std::vector<int> > targetTokenIds(n);
+  std::vector<TokenRange> targetTokenStreams(n);
+  size_t tokens = sourceTokenStream.size();
+  for (size_t i = 0; i < n; ++i) {
+    lexedTargetTokStreams[i] = theTokenLexer.tokenize(targetPaths[differing[i]]);
+    discardWhitespace(lexedTargetTokStreams[i], targetPositions[i],
+                      &targetTokenIds[i]);
+    targetTokenStreams[i] = TokenRange(lexedTargetTokStreams[i], 
+                                       targetPositions[i], targetTokenIds[i]);
+    tokens += targetTokenStreams[i].size();
+  }
+
+  // Find the anchors of every pair with one suffix array, then diff the 
+  // targets in parallel. Each one writes its edit script to a buffer of its
+  // own, and the buffers are printed in the order the targets were given.
+  std::vector<char *> outputs(n, (char *)0);
+  std::vector<size_t> outputSizes(n, 0);
+  if (SuffixArray::fits(tokens, n + 1))
+    compareWithTargets<int>(lexedSourceTokStream, sourceTokenStream, 
+                            lexedTargetTokStreams, targetTokenStreams, 
+                            differing, DBs, outputs, outputSizes);
+  else
+    compareWithTargets<int64_t>(lexedSourceTokStream, sourceTokenStream, 
+                                lexedTargetTokStreams, targetTokenStreams, 
+                                differing, DBs, outputs, outputSizes);
+
+  for (size_t i = 0; i < n; ++i) {
+    if (outputSizes[i] > 0) {
+      printf("ndiff %s %s\n", sourcePath.c_str(), 
+             targetPaths[differing[i]].c_str());
+      fwrite(outputs[i], 1, outputSizes[i], stdout);
+    }
+    free(outputs[i]);
+  }
+  return DBs;
+}
+
+template <typename Index>
+void NDiff::compareWithTargets(
+    const std::vector<Token> &lexedSourceTokStream,
+    TokenRange sourceTokenStream,
+    const std::vector<std::vector<Token> > &lexedTargetTokStreams,
+    const std::vector<TokenRange> &targetTokenStreams,
+    const std::vector<size_t> &differing,
+    std::vector<std::list<DiffBlock> > &DBs,
+    std::vector<char *> &outputs, std::vector<size_t> &outputSizes) {
+  BasicAnchorAnalysis<Index> anchorAnalyzer(saConstruction);
+  const std::vector<std::vector<BasicAnchor<Index> > > anchors(
+      anchorAnalyzer.findAnchors(sourceTokenStream, targetTokenStreams));
+
+  parallelFor(targetTokenStreams.size(), 0, [&](size_t i) {
+    FILE *out = open_memstream(&outputs[i], &outputSizes[i]);
+    DBs[differing[i]] = compareTokenStreams<Index>(
+        lexedSourceTokStream, lexedTargetTokStreams[i], 
+        sourceTokenStream, targetTokenStreams[i], 0, &anchors[i], 
+        out ? out : stdout);
+    if (out)
+      fclose(out);
+  });
+}
+
+void NDiff::computeBatchDifferences(
+    const std::vector<std::pair<std::string, std::string> > &pairs) {
+  // A pair counts as small by the size of its files, which is known before 
+  // lexing them. Byte-identical pairs have nothing to report.
+  std::vector<size_t> batch;
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    const std::string &sourcePath = pairs[i].first, &targetPath = pairs[i].second;
+    if (MappedFile::identical(sourcePath, targetPath))
+      continue;
+    struct stat sourceStat, targetStat;
+    if (stat(sourcePath.c_str(), &sourceStat) == 0 && 
+        stat(targetPath.c_str(), &targetStat) == 0 &&
+        sourceStat.st_size + targetStat.st_size <= SmallPairBytes) {
+      batch.push_back(i);
+      if (batch.size() == (size_t)BatchPairs) {
+        compareBatch(pairs, batch);
+        batch.clear();
+      }
+      continue;
+    }
+
+    // A large pair keeps the output in order by flushing the batch first.
+    if (!batch.empty()) {
+      compareBatch(pairs, batch);
+      batch.clear();
+    }
+    TokenLexer theTokenLexer;
+    const std::vector<Token> lexedSourceTokStream(theTokenLexer.tokenize(sourcePath));
+    const std::vector<Token> lexedTargetTokStream(theTokenLexer.tokenize(targetPath));
+    char *output = 0;
+    size_t outputSize = 0;
+    FILE *out = open_memstream(&output, &outputSize);
+    std::vector<int64_t> sourcePositions, targetPositions;
+    std::vector<int> sourceTokenIds, targetTokenIds;
+    discardWhitespace(lexedSourceTokStream, sourcePositions, &sourceTokenIds);
+    discardWhitespace(lexedTargetTokStream, targetPositions, &targetTokenIds);
+    compareTokenStreams<int>(lexedSourceTokStream, lexedTargetTokStream,
+                             TokenRange(lexedSourceTokStream, sourcePositions,
+                                        sourceTokenIds),
+                             TokenRange(lexedTargetTokStream, targetPositions,
+                                        targetTokenIds),
+                             0, 0, out ? out : stdout);
+    if (out)
+      fclose(out);
+    if (outputSize > 0) {
+      printf("ndiff %s %s\n", sourcePath.c_str(), targetPath.c_str());
+      fwrite(output, 1, outputSize, stdout);
+    }
+    free(output);
+  }
+  if (!batch.empty())
+    compareBatch(pairs, batch);
+}
+
+int NDiff::compareTrees(const std::string &sourceDir, 
+                        const std::string &targetDir, bool brief) {
+  std::string sourceRoot(sourceDir), targetRoot(targetDir);
+  while (sourceRoot.size() > 1 && sourceRoot[sourceRoot.size() - 1] == '/')
+    sourceRoot.erase(sourceRoot.size() - 1);
+  while (targetRoot.size() > 1 && targetRoot[targetRoot.size() - 1] == '/')
+    targetRoot.erase(targetRoot.size() - 1);
+  std::map<std::string, off_t> sourceFiles, targetFiles;
+  bool ok = listFiles(sourceRoot, "", sourceFiles);
+  ok = listFiles(targetRoot, "", targetFiles) && ok;
+
+  // Walk both lists in path order. A file found in only one tree is 
+  // reported in its place, under the root it was found in; one found in 
+  // both becomes a pair to compare.
+  std::vector<std::string> paths;
+  std::vector<off_t> sizes;
+  std::vector<const std::string *> onlyRoots;
+  std::map<std::string, off_t>::const_iterator 
+    s = sourceFiles.begin(), t = targetFiles.begin();
+  while (s != sourceFiles.end() || t != targetFiles.end()) {
+    if (t == targetFiles.end() || 
+        (s != sourceFiles.end() && s->first < t->first)) {
+      paths.push_back(s->first);
+      sizes.push_back(s->second);
+      onlyRoots.push_back(&sourceRoot);
+      ++s;
+    } else if (s == sourceFiles.end() || t->first < s->first) {
+      paths.push_back(t->first);
+      sizes.push_back(t->second);
+      onlyRoots.push_back(&targetRoot);
+      ++t;
+    } else {
+      paths.push_back(s->first);
+      sizes.push_back(s->second + t->second);
+      onlyRoots.push_back(0);
+      ++s;
+      ++t;
+    }
+  }
+
+  // Compare the pairs on every hardware thread, the largest first, so that
+  // a big pair picked up late does not leave the other threads idle at the
+  // end. Each pair has a lexer and an output buffer of its own. In brief 
+  // mode the tokens are only compared, up to the first that differ.
+  std::vector<size_t> order;
+  for (size_t i = 0; i < paths.size(); ++i)
+    if (!onlyRoots[i])
+      order.push_back(i);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return sizes[a] > sizes[b];
+  });
+  std::vector<char *> outputs(paths.size(), (char *)0);
+  std::vector<size_t> outputSizes(paths.size(), 0);
+  std::vector<char> differ(paths.size(), 0), failed(paths.size(), 0);
+  parallelFor(order.size(), 0, [&](size_t j) {
+    const size_t i = order[j];
+    const std::string sourcePath = sourceRoot + "/" + paths[i];
+    const std::string targetPath = targetRoot + "/" + paths[i];
+    if (MappedFile::identical(sourcePath, targetPath))
+      return;
+    TokenLexer theTokenLexer;
+    if (brief) {
+      differ[i] = theTokenLexer.tokenStreamsDiffer(sourcePath, targetPath);
+      return;
+    }
+    FILE *out = open_memstream(&outputs[i], &outputSizes[i]);
+    if (!out) {
+      fprintf(stderr, "ndiff: cannot buffer the edit script of %s: %s\n",
+              paths[i].c_str(), strerror(errno));
+      failed[i] = 1;
+      return;
+    }
+    const std::vector<Token> lexedSourceTokStream(
+        theTokenLexer.tokenize(sourcePath));
+    const std::vector<Token> lexedTargetTokStream(
+        theTokenLexer.tokenize(targetPath));
+    std::vector<int64_t> sourcePositions, targetPositions;
+    std::vector<int> sourceTokenIds, targetTokenIds;
+    discardWhitespace(lexedSourceTokStream, sourcePositions, &sourceTokenIds);
+    discardWhitespace(lexedTargetTokStream, targetPositions, &targetTokenIds);
+    compareTokenStreams<int>(lexedSourceTokStream, lexedTargetTokStream,
+                             TokenRange(lexedSourceTokStream, sourcePositions,
+                                        sourceTokenIds),
+                             TokenRange(lexedTargetTokStream, targetPositions,
+                                        targetTokenIds),
+                             0, 0, out);
+    fclose(out);
+    differ[i] = outputSizes[i] > 0;
+  });
+
+  // A pair whose edit script could not be buffered is trouble, like a file
+  // that could not be read.
+  bool anyDiffer = false;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (onlyRoots[i]) {
+      onlyIn(*onlyRoots[i], paths[i]);
+      anyDiffer = true;
+    } else if (failed[i]) {
+      ok = false;
+    } else if (differ[i]) {
+      const std::string sourcePath = sourceRoot + "/" + paths[i];
+      const std::string targetPath = targetRoot + "/" + paths[i];
+      if (brief) {
+        printf("Files %s and %s differ\n", sourcePath.c_str(), 
+               targetPath.c_str());
+      } else {
+        printf("ndiff %s %s\n", sourcePath.c_str(), targetPath.c_str());
+        fwrite(outputs[i], 1, outputSizes[i], stdout);
+      }
+      anyDiffer = true;
+    }
+    free(outputs[i]);
+  }
+  return !ok ? 2 : anyDiffer ? 1 : 0;
+}
+
+void NDiff::compareBatch(
+    const std::vector<std::pair<std::string, std::string> > &pairs,
+    const std::vector<size_t> &batch) {
+  // Lex every file with one lexer, leaving an id below the tokens for the 
+  // sentinel of each of them.
+  const size_t n = batch.size();
+  TokenLexer theTokenLexer(2 * n);
+  std::vector<std::vector<Token> > lexedTokStreams(2 * n);
+  std::vector<std::vector<int64_t> > positions(2 * n);
+  std::vector<std::vector<int> > tokenIds(2 * n);
+  std::vector<TokenRange> tokenStreams(2 * n);
+  size_t tokens = 0;
+  for (size_t p = 0; p < n; ++p) {
+    lexedTokStreams[2 * p] = theTokenLexer.tokenize(pairs[batch[p]].first);
+    lexedTokStreams[2 * p + 1] = theTokenLexer.tokenize(pairs[batch[p]].second);
+    for (size_t k = 2 * p; k < 2 * p + 2; ++k) {
+      discardWhitespace(lexedTokStreams[k], positions[k], &tokenIds[k]);
+      tokenStreams[k] = TokenRange(lexedTokStreams[k], positions[k], 
+                                   tokenIds[k]);
+      tokens += tokenStreams[k].size();
+    }
+  }
+
+  std::vector<char *> outputs(n, (char *)0);
+  std::vector<size_t> outputSizes(n, 0);
+  if (SuffixArray::fits(tokens, 2 * n))
+    compareBatchWith<int>(lexedTokStreams, tokenStreams, outputs, outputSizes);
+  else
+    compareBatchWith<int64_t>(lexedTokStreams, tokenStreams, outputs, 
+                              outputSizes);
+
+  for (size_t p = 0; p < n; ++p) {
+    if (outputSizes[p] > 0) {
+      printf("ndiff %s %s\n", pairs[batch[p]].first.c_str(), 
+             pairs[batch[p]].second.c_str());
+      fwrite(outputs[p], 1, outputSizes[p], stdout);
+    }
+    free(outputs[p]);
+  }
+}
+
+template <typename Index>
+void NDiff::compareBatchWith(
+    const std::vector<std::vector<Token> > &lexedTokStreams,
+    const std::vector<TokenRange> &tokenStreams,
+    std::vector<char *> &outputs, std::vector<size_t> &outputSizes) {
+  BasicAnchorAnalysis<Index> anchorAnalyzer(saConstruction);
+  const std::vector<std::vector<BasicAnchor<Index> > > anchors(
+      anchorAnalyzer.findBatchAnchors(tokenStreams));
+
+  parallelFor(anchors.size(), 0, [&](size_t p) {
+    FILE *out = open_memstream(&outputs[p], &outputSizes[p]);
+    compareTokenStreams<Index>(
+        lexedTokStreams[2 * p], lexedTokStreams[2 * p + 1], 
+        tokenStreams[2 * p], tokenStreams[2 * p + 1], 0, &anchors[p], 
+        out ? out : stdout);
+    if (out)
+      fclose(out);
+  });
+}
+
+template <typename Index>
+std::list<DiffBlock> NDiff::compareTokenStreams(
+    const std::vector<Token> &lexedSourceTokStream,
+    const std::vector<Token> &lexedTargetTokStream,
+    TokenRange sourceTokenStream,
+    TokenRange targetTokenStream,
+    std::vector<int> *targetIds,
+    const std::vector<BasicAnchor<Index> > *anchors,
+    FILE *out) {
+  // Check for equality. Streams of the same length are equal if one is a 
+  // prefix of the other, so the scan for the common prefix tells.
   std::list<DiffBlock> DBs;
-  if (sourceTokenStream == targetTokenStream) {
+  int64_t commonlength = commonPrefix(sourceTokenStream, targetTokenStream);
+  if (sourceTokenStream.size() == targetTokenStream.size() &&
+      commonlength == (int64_t)sourceTokenStream.size()) {
     if (!sourceTokenStream.empty()) {
       DBs.push_back(DiffBlock(EQUAL, lexedSourceTokStream));
     }
@@ -61,35 +775,49 @@ std::list<DiffBlock> NDiff::computeDifference(
   }
 
   // Discard common prefix.
-  int commonlength = commonPrefix(sourceTokenStream, targetTokenStream);
-  const std::vector<Token> commonprefix(left(sourceTokenStream, commonlength));
-  sourceTokenStream = mid(sourceTokenStream, commonlength);
-  targetTokenStream = mid(targetTokenStream, commonlength);
+  const int64_t prefixLength = commonlength;
+  const TokenRange commonprefix(sourceTokenStream.slice(0, commonlength));
+  sourceTokenStream = sourceTokenStream.slice(commonlength);
+  targetTokenStream = targetTokenStream.slice(commonlength);
 
   // Discard common suffix.
   commonlength = commonSuffix(sourceTokenStream, targetTokenStream);
-  const std::vector<Token> commonsuffix(right(sourceTokenStream, commonlength));
-  sourceTokenStream = left(sourceTokenStream, sourceTokenStream.size() - commonlength);
-  targetTokenStream = left(targetTokenStream, targetTokenStream.size() - commonlength);
+  const TokenRange commonsuffix(
+      sourceTokenStream.slice(sourceTokenStream.size() - commonlength));
+  sourceTokenStream = 
+    sourceTokenStream.slice(0, sourceTokenStream.size() - commonlength);
+  targetTokenStream = 
+    targetTokenStream.slice(0, targetTokenStream.size() - commonlength);
 
   // Find long common sequences of tokens interspersed with 
   // groups of differing tokens. The idea here is to match up these long 
   // sequences between the two streams, and by then comparing the groups of 
   // differing tokens that line up we can yield a tighter result from any
   // longest common subsequence based difference algorithm.
-  AnchorAnalysis anchorAnalyzer;
-  const std::vector<Anchor> anchors(
-      anchorAnalyzer.findAnchors(sourceTokenStream, targetTokenStream));
-  if (anchors.empty()) {
-    // Normal token-based diff. Run a difference algorithm on the
-    // sourceTokenStream and targetTokenStream.
-    DiffAlgorithm diff;
-    DBs = diff.computeDifference(sourceTokenStream, targetTokenStream);
+  //
+  // Anchors found beforehand only need trimming like the streams. With an 
+  // index only the target's share of the ids needs trimming. Otherwise, 
+  // 32-bit suffix array entries take half the memory bandwidth of 64-bit 
+  // ones, so the wider type is only used when the streams need it.
+  std::list<DiffBlock> moves;
+  if (anchors) {
+    DBs = compareBetweenAnchors(sourceTokenStream, targetTokenStream,
+        clipAnchors(*anchors, prefixLength, sourceTokenStream.size(),
+                    targetTokenStream.size()));
+  } else if (targetIds) {
+    targetIds->erase(targetIds->begin() + prefixLength + targetTokenStream.size(),
+                     targetIds->end());
+    targetIds->erase(targetIds->begin(), targetIds->begin() + prefixLength);
+    DBs = compareWithIndex(sourceTokenStream, targetTokenStream, prefixLength,
+                           *targetIds, detectMoves ? &moves : 0);
+  } else if (SuffixArray::fits(sourceTokenStream.size() + 
+                               targetTokenStream.size())) {
+    DBs = compareWithAnchors<int>(sourceTokenStream, targetTokenStream,
+                                  detectMoves ? &moves : 0);
   } else {
-    // Run a difference algorithm on the groups of differing tokens that line up
-    // between anchors.
-    DBs = compareBetweenAnchors(sourceTokenStream, targetTokenStream, anchors);
-  }  
+    DBs = compareWithAnchors<int64_t>(sourceTokenStream, targetTokenStream,
+                                      detectMoves ? &moves : 0);
+  }
 
   // Restore the prefix and suffix.
   DBs.push_front(DiffBlock(EQUAL, commonprefix));
@@ -102,52 +830,290 @@ std::list<DiffBlock> NDiff::computeDifference(
 
   // Restore whitespace information from the original lexed token streams.
   DBs = insertWhitespace(DBs, lexedSourceTokStream, lexedTargetTokStream);
-  prettyOutput(DBs);
+  if (!moves.empty())
+    DBs = extractMoves(DBs, moves, lexedSourceTokStream, lexedTargetTokStream);
+  prettyOutput(DBs, out);
   return DBs;
 }
 
-std::vector<Token> NDiff::discardWhitespace(const std::vector<Token> &tokenStream) {
-  const int size = tokenStream.size();
-  std::vector<Token> result;
-  result.reserve(size);
-  for (int i = 0; i < size; ++i)
-    if (!tokenStream[i].isWhitespace())
-      result.push_back(tokenStream[i]);
+template <typename Index>
+std::vector<BasicAnchor<Index> > NDiff::clipAnchors(
+    const std::vector<BasicAnchor<Index> > &anchors, int64_t first,
+    int64_t sourceSize, int64_t targetSize) {
+  std::vector<BasicAnchor<Index> > result;
+  typename std::vector<BasicAnchor<Index> >::const_iterator 
+    i(anchors.begin()), e(anchors.end());
+  for (; i != e; ++i) {
+    // Cut off the ends that reach out of either stream's share.
+    const int64_t s = i->sourceIdx() - first, t = i->targetIdx() - first;
+    const int64_t lo = std::max((int64_t)0, std::max(-s, -t));
+    const int64_t hi = std::min((int64_t)i->length(), 
+                                std::min(sourceSize - s, targetSize - t));
+    if (hi - lo > 0)
+      result.push_back(BasicAnchor<Index>(s + lo, t + lo, hi - lo));
+  }
   return result;
 }
 
-int NDiff::commonPrefix(const std::vector<Token> &sourceTokenStream, 
-                        const std::vector<Token> &targetTokenStream) {
-  const int e = std::min(sourceTokenStream.size(), targetTokenStream.size());
-  for (int i = 0; i < e; ++i) 
+bool NDiff::writeIndex(const std::string &referencePath, 
+                       const std::string &indexPath) {
+  TokenLexer theTokenLexer;
+  const std::vector<Token> lexedTokStream(theTokenLexer.tokenize(referencePath));
+  std::vector<int64_t> positions;
+  discardWhitespace(lexedTokStream, positions);
+  const TokenRange tokenStream(lexedTokStream, positions, std::vector<int>());
+  if (!ReferenceIndex::fits(tokenStream.size())) {
+    fprintf(stderr, "ndiff: %s: too many tokens to index; an index holds at "
+                    "most %lld\n", referencePath.c_str(), 
+            (long long)ReferenceIndex::MaxTokens);
+    return false;
+  }
+  return ReferenceIndex::write(indexPath, tokenStream, 
+                               theTokenLexer.dictionary());
+}
+
+size_t NDiff::reportClones(const std::vector<std::string> &paths, 
+                           int64_t minLength) {
+  // Lex every file with one lexer, so that equal tokens get equal ids in all
+  // of them, and leave an id below the tokens for each file's sentinel.
+  TokenLexer theTokenLexer(paths.size());
+  std::vector<std::vector<Token> > lexedTokStreams(paths.size());
+  std::vector<std::vector<int64_t> > positions(paths.size());
+  std::vector<TokenRange> tokenStreams(paths.size());
+  size_t tokens = 0;
+  for (size_t k = 0; k < paths.size(); ++k) {
+    lexedTokStreams[k] = theTokenLexer.tokenize(paths[k]);
+    discardWhitespace(lexedTokStreams[k], positions[k]);
+    tokenStreams[k] = TokenRange(lexedTokStreams[k], positions[k], 
+                                 std::vector<int>());
+    tokens += tokenStreams[k].size();
+  }
+  if (SuffixArray::fits(tokens, paths.size()))
+    return printClones<int>(paths, tokenStreams, minLength);
+  return printClones<int64_t>(paths, tokenStreams, minLength);
+}
+
+template <typename Index>
+size_t NDiff::printClones(const std::vector<std::string> &paths,
+                          const std::vector<TokenRange> &tokenStreams,
+                          int64_t minLength) {
+  BasicCloneAnalysis<Index> cloneAnalyzer(saConstruction);
+  const std::vector<BasicClone<Index> > clones(
+      cloneAnalyzer.findClones(tokenStreams, minLength));
+
+  for (size_t c = 0; c < clones.size(); ++c) {
+    const BasicClone<Index> &clone = clones[c];
+    printf("clone of %lld tokens at %zu places\n", (long long)clone.length,
+           clone.occurrences.size());
+    for (size_t o = 0; o < clone.occurrences.size(); ++o) {
+      const TokenRange tokStream = tokenStreams[clone.occurrences[o].first];
+      const Token &first = tokStream[clone.occurrences[o].second];
+      const Token &last = 
+        tokStream[clone.occurrences[o].second + clone.length - 1];
+      printf("  %s:%d,%d-%d,%d\n", paths[clone.occurrences[o].first].c_str(),
+             first.getLine(), first.getColumn(), last.getLine(), 
+             last.getColumn());
+    }
+  }
+  return clones.size();
+}
+
+bool NDiff::translateTokens(const TokenLexer &lexer,
+                            TokenRange sourceTokenStream,
+                            TokenRange targetTokenStream,
+                            std::vector<int> &targetIds) {
+  const ReferenceIndex &index = *referenceIndex;
+  const int64_t size = sourceTokenStream.size();
+
+  // Look up every distinct token once. Tokens the reference does not have 
+  // get -1, which matches nothing.
+  const std::map<std::string, int> &dictionary = lexer.dictionary();
+  std::vector<int> translation;
+  std::map<std::string, int>::const_iterator i(dictionary.begin()),
+                                             e(dictionary.end());
+  for (; i != e; ++i) {
+    if (translation.size() <= (size_t)i->second)
+      translation.resize(i->second + 1, -1);
+    translation[i->second] = index.lookup(i->first);
+  }
+
+  bool matches = (size == index.size());
+  for (int64_t j = 0; matches && j < size; ++j)
+    matches = translation[sourceTokenStream[j].getHashValue()] == 
+              index.tokenIds()[j];
+  if (!matches) {
+    fprintf(stderr, "ndiff: the index was not built from this source; "
+                    "ignoring it\n");
+    return false;
+  }
+
+  targetIds.resize(targetTokenStream.size());
+  for (int64_t j = 0, e = targetTokenStream.size(); j < e; ++j)
+    targetIds[j] = translation[targetTokenStream[j].getHashValue()];
+  return true;
+}
+
+bool NDiff::filesDiffer(const std::string &sourcePath, 
+                        const std::string &targetPath) {
+  if (MappedFile::identical(sourcePath, targetPath))
+    return false;
+  TokenLexer theTokenLexer;
+  return theTokenLexer.tokenStreamsDiffer(sourcePath, targetPath);
+}
+
+void NDiff::discardWhitespace(const std::vector<Token> &tokenStream,
+                              std::vector<int64_t> &positions,
+                              std::vector<int> *ids) {
+  const int64_t size = tokenStream.size();
+  positions.clear();
+  positions.reserve(size);
+  if (ids) {
+    ids->clear();
+    ids->reserve(size);
+  }
+  for (int64_t i = 0; i < size; ++i)
+    if (!tokenStream[i].isWhitespace()) {
+      positions.push_back(i);
+      if (ids)
+        ids->push_back(tokenStream[i].getHashValue());
+    }
+}
+
+int64_t NDiff::commonPrefix(TokenRange sourceTokenStream, 
+                            TokenRange targetTokenStream) {
+  const int64_t e = std::min(sourceTokenStream.size(), targetTokenStream.size());
+  int64_t i = 0;
+  const int *sourceIds = sourceTokenStream.ids(), 
+            *targetIds = targetTokenStream.ids();
+  if (sourceIds && targetIds)
+    while (i + IdBlock <= e && 
+           memcmp(sourceIds + i, targetIds + i, IdBlock * sizeof(int)) == 0)
+      i += IdBlock;
+  for (; i < e; ++i) 
     if (sourceTokenStream[i] != targetTokenStream[i]) 
       return i; 
   return e;
 }
 
-int NDiff::commonSuffix(const std::vector<Token> &sourceTokenStream, 
-                        const std::vector<Token> &targetTokenStream) {
-  const int m = sourceTokenStream.size(), n = targetTokenStream.size();
-  const int e = std::min(m, n);
-  for (int i = 1; i <= e; ++i) 
+int64_t NDiff::commonSuffix(TokenRange sourceTokenStream, 
+                            TokenRange targetTokenStream) {
+  const int64_t m = sourceTokenStream.size(), n = targetTokenStream.size();
+  const int64_t e = std::min(m, n);
+  int64_t i = 1;
+  const int *sourceIds = sourceTokenStream.ids(), 
+            *targetIds = targetTokenStream.ids();
+  if (sourceIds && targetIds)
+    while (i + IdBlock - 1 <= e && 
+           memcmp(sourceIds + m - i - IdBlock + 1, targetIds + n - i - IdBlock + 1,
+                  IdBlock * sizeof(int)) == 0)
+      i += IdBlock;
+  for (; i <= e; ++i) 
     if (sourceTokenStream[m - i] != targetTokenStream[n - i])
       return i - 1;  
   return e;
 }
 
+template <typename Index>
+std::list<DiffBlock> NDiff::compareWithAnchors(
+    TokenRange sourceTokenStream, 
+    TokenRange targetTokenStream,
+    std::list<DiffBlock> *moves) {
+  BasicAnchorAnalysis<Index> anchorAnalyzer(saConstruction);
+  anchorAnalyzer.setMismatches(maxMismatches);
+  std::vector<BasicAnchor<Index> > anchors, unaligned;
+  if (moves)
+    anchorAnalyzer.setUnalignedAnchors(&unaligned);
+  bool found = false;
+  if (!externalDirectory.empty()) {
+    BasicExternalSuffixArray<Index> sa(externalDirectory, externalMemory);
+    found = anchorAnalyzer.findAnchors(sourceTokenStream, targetTokenStream, 
+                                       sa, anchors);
+    const TempFile::Statistics &stats = sa.statistics();
+    fprintf(stderr, "ndiff: external suffix array: %llu bytes read, "
+                    "%llu bytes written, %llu temporary files\n",
+            (unsigned long long)stats.bytesRead, 
+            (unsigned long long)stats.bytesWritten,
+            (unsigned long long)stats.files);
+    if (!found) {
+      fprintf(stderr, "ndiff: cannot write temporary files in %s; "
+                      "sorting in memory\n", externalDirectory.c_str());
+      unaligned.clear();
+    }
+  }
+  if (!found) {
+    int k = minimizerLength, w = minimizerWindow;
+    if (k == 0 && sparseSampling == 0 && (int64_t)(sourceTokenStream.size() + 
+        targetTokenStream.size()) >= MinimizerThreshold) {
+      k = DefaultMinimizerLength;
+      w = DefaultMinimizerWindow;
+    }
+    if (k)
+      anchors = anchorAnalyzer.findMinimizerAnchors(sourceTokenStream, 
+                                                    targetTokenStream, k, w);
+    else if (sparseSampling)
+      anchors = anchorAnalyzer.findSparseAnchors(sourceTokenStream, 
+                                                 targetTokenStream, 
+                                                 sparseSampling);
+    else
+      anchors = anchorAnalyzer.findAnchors(sourceTokenStream, 
+                                           targetTokenStream);
+  }
+  if (moves)
+    appendMoves(unaligned, sourceTokenStream, targetTokenStream, *moves);
+  return compareBetweenAnchors(sourceTokenStream, targetTokenStream, anchors);
+}
+
+std::list<DiffBlock> NDiff::compareWithIndex(
+    TokenRange sourceTokenStream, 
+    TokenRange targetTokenStream,
+    int64_t first, const std::vector<int> &targetIds,
+    std::list<DiffBlock> *moves) {
+  AnchorAnalysis anchorAnalyzer(saConstruction);
+  std::vector<Anchor> unaligned;
+  if (moves)
+    anchorAnalyzer.setUnalignedAnchors(&unaligned);
+  const std::vector<Anchor> anchors(
+      anchorAnalyzer.findAnchors(*referenceIndex, first, sourceTokenStream, 
+                                 targetTokenStream, targetIds));
+  if (moves)
+    appendMoves(unaligned, sourceTokenStream, targetTokenStream, *moves);
+  return compareBetweenAnchors(sourceTokenStream, targetTokenStream, anchors);
+}
+
+template <typename Index>
+void NDiff::appendMoves(const std::vector<BasicAnchor<Index> > &unaligned,
+                        TokenRange sourceTokenStream, 
+                        TokenRange targetTokenStream,
+                        std::list<DiffBlock> &moves) {
+  typename std::vector<BasicAnchor<Index> >::const_iterator 
+    i(unaligned.begin()), e(unaligned.end());
+  for (; i != e; ++i)
+    moves.push_back(DiffBlock(
+        sourceTokenStream.slice(i->sourceIdx(), i->length()),
+        targetTokenStream.slice(i->targetIdx(), i->length())));
+}
+
+template <typename Index>
 std::list<DiffBlock> NDiff::compareBetweenAnchors(
-    const std::vector<Token> &sourceTokenStream, 
-    const std::vector<Token> &targetTokenStream,
-    const std::vector<Anchor> &anchVector) {
+    TokenRange sourceTokenStream, 
+    TokenRange targetTokenStream,
+    const std::vector<BasicAnchor<Index> > &anchVector, int depth) {
   // Cache the anchor and token stream lengths to prevent multiple calls.
-  const int sourceStreamSize = sourceTokenStream.size();
-  const int targetStreamSize = targetTokenStream.size();
-  const int anchVecLength = anchVector.size();
+  const Index sourceStreamSize = sourceTokenStream.size();
+  const Index targetStreamSize = targetTokenStream.size();
+  const Index anchVecLength = anchVector.size();
 
   DiffAlgorithm diff; 
   std::list<DiffBlock> DBs;  
 
-  for (int i = 0; i <= anchVecLength; ++i) {
+  // Normal token-based diff. Run a difference algorithm on the
+  // sourceTokenStream and targetTokenStream.
+  if (anchVector.empty())
+    return diff.computeDifference(sourceTokenStream, targetTokenStream);
+
+  // Run a difference algorithm on the groups of differing tokens that line up
+  // between anchors.
+  for (Index i = 0; i <= anchVecLength; ++i) {
     // Compute the offsets in the token streams corrsonding to groups of 
     // differing tokens that line up between anchors. We need the offset marking
     // the start index and the end index of the sequence in each stream. 
@@ -156,7 +1122,7 @@ std::list<DiffBlock> NDiff::compareBetweenAnchors(
     //    offset[1][0] = offset to start from in the target stream
     //    offset[0][1] = offset to end from in the source stream
     //    offset[1][1] = offset to end from in the target stream
-    int offset[2][2];
+    Index offset[2][2];
 
     // We need to distinguish between three different cases when entering
     // offset data. The first and last anchors are special cases where as 
@@ -178,30 +1144,66 @@ std::list<DiffBlock> NDiff::compareBetweenAnchors(
       offset[1][1] = anchVector[i].targetIdx();
     }
 
-    std::vector<Token> fromTokens = mid(sourceTokenStream, 
+    const TokenRange fromTokens = sourceTokenStream.slice(
         offset[0][0], offset[0][1] - offset[0][0]);
-    std::vector<Token> toTokens = mid(targetTokenStream, 
+    const TokenRange toTokens = targetTokenStream.slice(
         offset[1][0], offset[1][1] - offset[1][0]);
-    std::list<DiffBlock> result = diff.computeDifference(fromTokens, toTokens);
+
+    // The threshold that kept the anchors is set by the longest repeats of 
+    // the whole streams. A large gap may still hold runs that are long for
+    // the gap alone; anchor it on its own before any diff is run on it.
+    std::vector<BasicAnchor<Index> > gapAnchors;
+    if (anchorGap > 0 && depth < anchorDepth && !fromTokens.empty() && 
+        !toTokens.empty() && 
+        (int64_t)(fromTokens.size() + toTokens.size()) >= anchorGap) {
+      BasicAnchorAnalysis<Index> anchorAnalyzer(saConstruction);
+      anchorAnalyzer.setMismatches(maxMismatches);
+      gapAnchors = anchorAnalyzer.findAnchors(fromTokens, toTokens);
+    }
+    std::list<DiffBlock> result;
+    if (!gapAnchors.empty())
+      result = compareBetweenAnchors(fromTokens, toTokens, gapAnchors, 
+                                     depth + 1);
+    else if (!directDifference(fromTokens, toTokens, result))
+      result = diff.computeDifference(fromTokens, toTokens);
     DBs.insert(DBs.end(), result.begin(), result.end());
 
     // We mark the anchors as EQUAL so they are considered in the output. Since
     // our loop needs to consider after the last anchor, we need to check for
     // this case before trying to acces any anchor data.
     if (i < anchVecLength) {
-      const int idx = anchVector[i].sourceIdx();
-      const int len = anchVector[i].length();
-      DBs.push_back(DiffBlock(EQUAL, mid(sourceTokenStream, idx, len)));
+      const Index idx = anchVector[i].sourceIdx();
+      const Index len = anchVector[i].length();
+      DBs.push_back(DiffBlock(EQUAL, sourceTokenStream.slice(idx, len)));
     }
   }
 
   return DBs;
 }
 
+bool NDiff::directDifference(TokenRange fromTokens,
+                             TokenRange toTokens,
+                             std::list<DiffBlock> &DBs) {
+  // These are the blocks diff itself would report: with no token in common
+  // the longest common subsequence is empty, and the change is all of it.
+  if (!fromTokens.empty() && !toTokens.empty() &&
+      (fromTokens.size() > MaxDirectGap || toTokens.size() > MaxDirectGap))
+    return false;
+  for (size_t i = 0; i < fromTokens.size(); ++i)
+    if (std::find(toTokens.begin(), toTokens.end(), fromTokens[i]) != 
+        toTokens.end())
+      return false;
+  if (!fromTokens.empty())
+    DBs.push_back(DiffBlock(DELETE, fromTokens));
+  if (!toTokens.empty())
+    DBs.push_back(DiffBlock(INSERT, toTokens));
+  return true;
+}
+
 std::list<DiffBlock> NDiff::insertWhitespace(
     const std::list<DiffBlock> &DBs, 
-    const std::vector<Token> &sourceTokenStream,
-    const std::vector<Token> &targetTokenStream) {
+    TokenRange sourceTokenStream,
+    TokenRange targetTokenStream) {
   std::list<DiffBlock> result;
   std::list<DiffBlock>::const_iterator i(DBs.begin()), e(DBs.end());
   for (; i != e; ++i) {
@@ -212,9 +1214,9 @@ std::list<DiffBlock> NDiff::insertWhitespace(
     // Each token in the DB's token vector maps to a token in the token stream 
     // according to its lexedOffset field. Token sequences in the diff blocks
     // have all whitespace data squeezed out and here is where we add it back.
-    const int a = DB.getTokens().front().lexedOffset();
-    const int b = DB.getTokens().back().lexedOffset();
-    const int len = b - a + 1;
+    const int64_t a = DB.getTokens().front().lexedOffset();
+    const int64_t b = DB.getTokens().back().lexedOffset();
+    const int64_t len = b - a + 1;
 
     if (len <= 0) 
       continue;
@@ -222,23 +1224,118 @@ std::list<DiffBlock> NDiff::insertWhitespace(
     // Token data for insertions comes from the targetTokenStream. For deletions
     // and equalities, the token data comes from the sourceTokenStream.
     const Operation op = DB.getOperation();
-    std::vector<Token> toks = (op == INSERT) ? 
-      mid(targetTokenStream, a, len) : mid(sourceTokenStream, a, len);
+    const TokenRange toks = (op == INSERT) ? 
+      targetTokenStream.slice(a, len) : sourceTokenStream.slice(a, len);
     result.push_back(DiffBlock(op, toks));
   }
 
   return result;
 }
 
-void NDiff::prettyOutput(std::list<DiffBlock> &DBs) {
+std::list<DiffBlock> NDiff::extractMoves(
+    const std::list<DiffBlock> &DBs, const std::list<DiffBlock> &moves,
+    TokenRange sourceTokenStream,
+    TokenRange targetTokenStream) {
+  // Mark the tokens DBs deletes and inserts. Whitespace between two blocks
+  // belongs to neither, so only the other tokens of a move are checked.
+  std::vector<char> deleted(sourceTokenStream.size(), 0), 
+                    inserted(targetTokenStream.size(), 0);
+  std::list<DiffBlock>::const_iterator i(DBs.begin()), e(DBs.end());
+  for (; i != e; ++i) {
+    const Operation op = i->getOperation();
+    if (op != DELETE && op != INSERT)
+      continue;
+    std::vector<char> &marks = (op == DELETE) ? deleted : inserted;
+    const std::vector<Token> &tokens = i->getTokens();
+    for (size_t j = 0; j < tokens.size(); ++j)
+      marks[tokens[j].lexedOffset()] = 1;
+  }
+
+  // Number the moves that were deleted and inserted in full by the source
+  // tokens they cover, and drop their target tokens from the insertions.
+  std::vector<const DiffBlock *> moved;
+  std::vector<int64_t> sourceMove(sourceTokenStream.size(), -1);
+  for (i = moves.begin(), e = moves.end(); i != e; ++i) {
+    const int64_t a = i->getTokens().front().lexedOffset(),
+                  b = i->getTokens().back().lexedOffset(),
+                  c = i->getDestination().front().lexedOffset(),
+                  d = i->getDestination().back().lexedOffset();
+    bool whole = true;
+    for (int64_t k = a; whole && k <= b; ++k)
+      whole = deleted[k] || sourceTokenStream[k].isWhitespace();
+    for (int64_t k = c; whole && k <= d; ++k)
+      whole = inserted[k] || targetTokenStream[k].isWhitespace();
+    if (!whole)
+      continue;
+    for (int64_t k = a; k <= b; ++k)
+      sourceMove[k] = moved.size();
+    for (int64_t k = c; k <= d; ++k)
+      inserted[k] = 2;
+    moved.push_back(&*i);
+  }
+  if (moved.empty())
+    return DBs;
+
+  // Split the deletions and insertions around the moved tokens. A MOVE 
+  // takes the place of the first of its source tokens.
+  std::list<DiffBlock> result;
+  for (i = DBs.begin(), e = DBs.end(); i != e; ++i) {
+    const Operation op = i->getOperation();
+    if (op != DELETE && op != INSERT) {
+      result.push_back(*i);
+      continue;
+    }
+    const std::vector<Token> &tokens = i->getTokens();
+    std::vector<Token> kept;
+    bool significant = false;
+    for (size_t j = 0; j <= tokens.size(); ++j) {
+      const int64_t offset = (j < tokens.size()) ? tokens[j].lexedOffset() : -1;
+      const bool isMoved = offset >= 0 && 
+        ((op == DELETE) ? sourceMove[offset] >= 0 : inserted[offset] == 2);
+      if (offset >= 0 && !isMoved) {
+        kept.push_back(tokens[j]);
+        significant = significant || !tokens[j].isWhitespace();
+        continue;
+      }
+      // Whitespace left over from a split block is not worth a block.
+      if (significant)
+        result.push_back(DiffBlock(op, kept));
+      kept.clear();
+      significant = false;
+      if (isMoved && op == DELETE && 
+          offset == moved[sourceMove[offset]]->getTokens().front().lexedOffset()) {
+        const DiffBlock &move = *moved[sourceMove[offset]];
+        const int64_t a = move.getTokens().front().lexedOffset(),
+                      b = move.getTokens().back().lexedOffset(),
+                      c = move.getDestination().front().lexedOffset(),
+                      d = move.getDestination().back().lexedOffset();
+        result.push_back(DiffBlock(sourceTokenStream.slice(a, b - a + 1),
+                                   targetTokenStream.slice(c, d - c + 1)));
+      }
+    }
+  }
+  return result;
+}
+
+void NDiff::prettyOutput(std::list<DiffBlock> &DBs, FILE *out) {
   std::list<DiffBlock>::iterator i(DBs.begin()), e(DBs.end());
   for (; i != e; ++i) {
-    std::vector<Token> tokenStream = (*i).getTokens();
+    const std::vector<Token> &tokenStream = (*i).getTokens();
     Operation op = (*i).getOperation();
 
     if (op == EQUAL) 
       continue;
 
+    if (op == MOVE) {
+      const std::vector<Token> &destination = (*i).getDestination();
+      fprintf(out, "%d,%dm%d,%d\n@ %d,%d,%d,%d\n", 
+              tokenStream.front().getLine(), tokenStream.front().getColumn(),
+              tokenStream.back().getLine(), tokenStream.back().getColumn(),
+              destination.front().getLine(), destination.front().getColumn(),
+              destination.back().getLine(), destination.back().getColumn());
+      continue;
+    }
+
     const int lin = tokenStream.front().getLine();
     const int col = tokenStream.front().getColumn();
     const int linEnd = tokenStream.back().getLine();      
@@ -246,19 +1343,19 @@ void NDiff::prettyOutput(std::list<DiffBlock> &DBs) {
     const char cmd = (op == DELETE) ? 'd' : 'a';
     const char marker = (op == DELETE) ? '<' : '>'; 
 
-    printf("%d,%d%c%d,%d\n", lin, col, cmd, linEnd, colEnd);
-    fputc(marker, stdout);
-    fputc(' ', stdout);
+    fprintf(out, "%d,%d%c%d,%d\n", lin, col, cmd, linEnd, colEnd);
+    fputc(marker, out);
+    fputc(' ', out);
     for (int j = 0, end = tokenStream.size(); j < end; ++j) {
-      std::string chardata = tokenStream[j].getCharData();
+      const std::string &chardata = tokenStream[j].getCharData();
       for (int c = 0; c < chardata.size(); ++c) {
-        fputc(chardata[c], stdout);
+        fputc(chardata[c], out);
         if (chardata[c] == '\n') {
-          fputc(marker, stdout);
-          fputc(' ', stdout);
+          fputc(marker, out);
+          fputc(' ', out);
         }
       }
     }
-    fputc('\n', stdout);  
+    fputc('\n', out);  
   }
 }
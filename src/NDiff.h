@@ -11,90 +11,351 @@
 #ifndef NDIFF_H
 #define NDIFF_H
 
-class Anchor;
+template <typename Index> class BasicAnchor;
 class DiffBlock;
+class ReferenceIndex;
 class Token;
+class TokenLexer;
 
+#include "SuffixArray.h"
+#include "TokenRange.h"
 #include <algorithm>
+#include <cstdio>
 #include <list>
+#include <stdint.h>
 #include <string>
+#include <utility>
 #include <vector>
 
 /// NDiff - This class implements the ndiff file comparison algorithm.
 class NDiff {
+public:
+  /// DefaultAnchorGap, DefaultAnchorDepth - Gaps between anchors of this 
+  /// many tokens are anchored again, this many levels deep, unless told 
+  /// otherwise.
+  static const int64_t DefaultAnchorGap = 1024;
+  static const int DefaultAnchorDepth = 4;
+
+private:
+  /// The algorithm used to build suffix arrays during anchor analysis.
+  SuffixArray::Construction saConstruction;
+
+  /// A prebuilt index of the source file, or null.
+  const ReferenceIndex *referenceIndex;
+
+  /// Find anchors with a suffix array of roughly every sparseSampling-th
+  /// suffix, or of all suffixes when 0.
+  int sparseSampling;
+
+  /// Seed anchors with the (minimizerWindow,minimizerLength)-minimizers of 
+  /// both files instead of a suffix array when minimizerLength is not 0.
+  int minimizerLength, minimizerWindow;
+
+  /// Look for anchors again inside gaps between anchors of at least 
+  /// anchorGap tokens in both streams together, at most anchorDepth levels
+  /// deep. An anchorGap of 0 never looks again.
+  int64_t anchorGap;
+  int anchorDepth;
+
+  /// Print blocks that were moved as references to where they went instead
+  /// of deleting and inserting them.
+  bool detectMoves;
+
+  /// Let anchors found with a suffix array hold up to this many substituted
+  /// tokens.
+  int maxMismatches;
+
+  /// Where to build suffix arrays on disk, or empty to build them in memory.
+  std::string externalDirectory;
+
+  /// The RAM budget of suffix arrays built on disk, in bytes.
+  size_t externalMemory;
 public:
   /// NDiff default constructor - Create a new NDiff instance.
-  NDiff() {};
+  NDiff() 
+    : saConstruction(SuffixArray::AutomaticConstruction), referenceIndex(0),
+      sparseSampling(0), minimizerLength(0), minimizerWindow(0), 
+      anchorGap(DefaultAnchorGap), anchorDepth(DefaultAnchorDepth), 
+      detectMoves(false), maxMismatches(0), externalMemory(0) {};
+
+  /// setSuffixArrayConstruction - Select the suffix array construction 
+  /// algorithm used to find anchors.
+  void setSuffixArrayConstruction(SuffixArray::Construction algorithm) {
+    saConstruction = algorithm;
+  }
+
+  /// setReferenceIndex - Find the anchors with a prebuilt index of the 
+  /// source file instead of a suffix array of both files. An index that 
+  /// does not match the source is ignored with a warning.
+  void setReferenceIndex(const ReferenceIndex *index) {
+    referenceIndex = index;
+  }
+
+  /// setSparseSampling - Find the anchors between two files with a suffix 
+  /// array of about every k-th suffix, which takes about a k-th of the 
+  /// memory of a full one. A k of 0 sorts all suffixes again.
+  void setSparseSampling(int k) {
+    sparseSampling = k;
+  }
+
+  /// setMinimizerSeeding - Find the anchors between two files from their 
+  /// shared minimizers of every w runs of k tokens, without any suffix 
+  /// array. Matches of fewer than w + k - 1 tokens can be missed. A k of 0 
+  /// leaves the choice to the size of the files again.
+  void setMinimizerSeeding(int k, int w) {
+    minimizerLength = k;
+    minimizerWindow = w;
+  }
+
+  /// setGapAnchoring - Find anchors again inside every gap between anchors
+  /// of at least minGap tokens, with a threshold of the gap's own, up to 
+  /// maxDepth levels deep. A minGap of 0 diffs every gap as it is.
+  void setGapAnchoring(int64_t minGap, int maxDepth) {
+    anchorGap = minGap;
+    anchorDepth = maxDepth;
+  }
+
+  /// setMoveDetection - Report the cross anchors that are out of order with
+  /// the others as MOVE blocks, from their place in the source to their 
+  /// place in the target, instead of deleting and inserting their tokens. 
+  /// Only pairs whose anchors are found on their own are checked for moves.
+  void setMoveDetection(bool detect) {
+    detectMoves = detect;
+  }
+
+  /// setMismatches - Let the anchors between two files hold up to k 
+  /// substituted tokens, which are reported as deleted and inserted without
+  /// running diff on them. Only anchors found with a full suffix array of 
+  /// the two files can. A k of 0 asks for exact anchors again.
+  void setMismatches(int k) {
+    maxMismatches = k;
+  }
+
+  /// setExternalConstruction - Build the suffix arrays of two files in 
+  /// temporary files in directory, sorting with about memory bytes of RAM,
+  /// and report their I/O volume on stderr. An empty directory builds them
+  /// in memory again.
+  void setExternalConstruction(const std::string &directory, size_t memory) {
+    externalDirectory = directory;
+    externalMemory = memory;
+  }
+
+  /// writeIndex - Build the ReferenceIndex of the file at referencePath and
+  /// store it at indexPath. Returns false if it could not be written, or if
+  /// the reference has too many tokens for an index, which is reported.
+  bool writeIndex(const std::string &referencePath, 
+                  const std::string &indexPath);
+
+  /// reportClones - Print every maximal run of at least minLength tokens 
+  /// that occurs more than once in the files at paths, within one file or 
+  /// across several, with the place of each occurrence. Returns the number
+  /// of runs printed.
+  size_t reportClones(const std::vector<std::string> &paths, 
+                      int64_t minLength);
 
   /// Runs the ndiff algorithm on the files at sourcePath and targetpath.
+  /// Byte-identical files are recognized before any lexing is done and yield
+  /// an empty list.
   std::list<DiffBlock> computeDifference(
       const std::string &sourcePath, const std::string &targetpath);
 
+  /// computeDifferences - Runs the ndiff algorithm on the file at sourcePath
+  /// and each of the files at targetPaths. The anchors of all the pairs come
+  /// from one generalized suffix array, and the pairs are diffed in 
+  /// parallel. The edit scripts are printed in the order of targetPaths, 
+  /// each under a line naming the two files, and returned in that order.
+  std::vector<std::list<DiffBlock> > computeDifferences(
+      const std::string &sourcePath, const std::vector<std::string> &targetPaths);
+
+  /// computeBatchDifferences - Runs the ndiff algorithm on each pair of 
+  /// files in pairs and prints the edit scripts in that order, each under a
+  /// line naming the two files. Consecutive small pairs are batched, so that
+  /// one generalized suffix array serves hundreds of them; larger pairs are
+  /// compared on their own.
+  void computeBatchDifferences(
+      const std::vector<std::pair<std::string, std::string> > &pairs);
+
+  /// compareTrees - Runs the ndiff algorithm on every pair of files found at
+  /// the same path under sourceDir and targetDir, and reports the files 
+  /// found under only one of them. The pairs are compared in parallel, the
+  /// largest first, and everything is printed in path order, each edit 
+  /// script under a line naming the two files. With brief, a pair is only
+  /// reported to differ, and its tokens are compared up to the first that
+  /// differ. Returns 1 if the trees differ, 0 if not and 2 if part of either
+  /// could not be read or compared, like diff -r.
+  int compareTrees(const std::string &sourceDir, const std::string &targetDir,
+                   bool brief);
+
+  /// filesDiffer - Returns true if the files at sourcePath and targetPath 
+  /// differ in anything but whitespace. Unlike computeDifference, no edit 
+  /// script is built and lexing stops at the first differing token.
+  bool filesDiffer(const std::string &sourcePath, const std::string &targetPath);
+
   /// commonPrefix - Return the number of tokens common to the start of each
-  ///                token stream.
-  int commonPrefix(const std::vector<Token> &sourceTokenStream, 
-                   const std::vector<Token> &targetTokenStream);
+  ///                token stream. When both streams have their ids at hand,
+  ///                these are compared a block at a time.
+  int64_t commonPrefix(TokenRange sourceTokenStream, 
+                       TokenRange targetTokenStream);
 
   /// commonSuffix - Return the number of tokens common to the end of each
-  ///                token stream.
-  int commonSuffix(const std::vector<Token> &sourceTokenStream, 
-                   const std::vector<Token> &targetTokenStream);
+  ///                token stream, scanning ids as commonPrefix does.
+  int64_t commonSuffix(TokenRange sourceTokenStream, 
+                       TokenRange targetTokenStream);
   
-  /// prettyOutput - 
-  void prettyOutput(std::list<DiffBlock> &DBs);
+  /// prettyOutput - Print the insertions and deletions of DBs to out. A 
+  ///                MOVE prints the range it had in the source, with an m 
+  ///                for the command, and on the next line, after an @, the 
+  ///                range it has in the target; its text is not repeated.
+  void prettyOutput(std::list<DiffBlock> &DBs, FILE *out = stdout);
 private:
+  /// compareTokenStreams - Diff the whitespace free token streams, trimmed of
+  ///                       their common prefix and suffix, and print the 
+  ///                       result to out. The lexed streams still hold the 
+  ///                       whitespace. Anchors are taken from anchors, if 
+  ///                       given, which were found for the untrimmed streams,
+  ///                       else from the reference index if targetIds holds 
+  ///                       the target's ids in it, else from a suffix array.
+  template <typename Index>
+  std::list<DiffBlock> compareTokenStreams(
+      const std::vector<Token> &lexedSourceTokStream,
+      const std::vector<Token> &lexedTargetTokStream,
+      TokenRange sourceTokenStream,
+      TokenRange targetTokenStream,
+      std::vector<int> *targetIds,
+      const std::vector<BasicAnchor<Index> > *anchors,
+      FILE *out);
+
+  /// compareWithTargets - Find the anchors between the source and every 
+  ///                      target with Index sized suffix array entries, and
+  ///                      diff the pairs in parallel. Target i was given as
+  ///                      number differing[i]; its edit script is stored 
+  ///                      there in DBs and its output in outputs[i].
+  template <typename Index>
+  void compareWithTargets(
+      const std::vector<Token> &lexedSourceTokStream,
+      TokenRange sourceTokenStream,
+      const std::vector<std::vector<Token> > &lexedTargetTokStreams,
+      const std::vector<TokenRange> &targetTokenStreams,
+      const std::vector<size_t> &differing,
+      std::vector<std::list<DiffBlock> > &DBs,
+      std::vector<char *> &outputs, std::vector<size_t> &outputSizes);
+
+  /// compareBatch - Diff the pairs of files in batch, given by their 
+  ///                numbers in pairs, with one generalized suffix array and
+  ///                print their edit scripts.
+  void compareBatch(
+      const std::vector<std::pair<std::string, std::string> > &pairs,
+      const std::vector<size_t> &batch);
+
+  /// compareBatchWith - Find the anchors of the lexed pairs, streams 2p and 
+  ///                    2p + 1, with Index sized suffix array entries, and 
+  ///                    diff the pairs in parallel. The output of pair p is
+  ///                    stored in outputs[p].
+  template <typename Index>
+  void compareBatchWith(
+      const std::vector<std::vector<Token> > &lexedTokStreams,
+      const std::vector<TokenRange> &tokenStreams,
+      std::vector<char *> &outputs, std::vector<size_t> &outputSizes);
+
+  /// printClones - Find and print the clones of the token streams, read 
+  ///               from paths, with Index sized suffix array entries.
+  template <typename Index>
+  size_t printClones(const std::vector<std::string> &paths,
+                     const std::vector<TokenRange> &tokenStreams,
+                     int64_t minLength);
+
+  /// compareWithAnchors - Find the anchors between the token streams with 
+  ///                      Index sized suffix array entries and diff the 
+  ///                      tokens around them.
+  template <typename Index>
+  std::list<DiffBlock> compareWithAnchors(
+      TokenRange sourceTokenStream, 
+      TokenRange targetTokenStream,
+      std::list<DiffBlock> *moves);
+
+  /// compareWithIndex - Find the anchors between the token streams with the
+  ///                    reference index and diff the tokens around them. 
+  ///                    The source stream starts first tokens into the 
+  ///                    reference.
+  std::list<DiffBlock> compareWithIndex(
+      TokenRange sourceTokenStream, 
+      TokenRange targetTokenStream,
+      int64_t first, const std::vector<int> &targetIds,
+      std::list<DiffBlock> *moves);
+
+  /// appendMoves - Append a MOVE to moves for each of the unaligned anchors
+  ///               between the token streams.
+  template <typename Index>
+  static void appendMoves(const std::vector<BasicAnchor<Index> > &unaligned,
+                          TokenRange sourceTokenStream, 
+                          TokenRange targetTokenStream,
+                          std::list<DiffBlock> &moves);
+
+  /// extractMoves - Replace the tokens of each of the moves, whose source 
+  ///                tokens DBs deletes and whose target tokens DBs inserts
+  ///                in full, with a MOVE where its source tokens were. 
+  ///                Other moves are left out.
+  std::list<DiffBlock> extractMoves(const std::list<DiffBlock> &DBs,
+                                    const std::list<DiffBlock> &moves,
+                                    TokenRange sourceTokenStream,
+                                    TokenRange targetTokenStream);
+
+  /// translateTokens - Map the lexer's token ids to the reference index's.
+  ///                   Returns false, and leaves targetIds alone, if the 
+  ///                   source stream is not the one the index was built from.
+  bool translateTokens(const TokenLexer &lexer,
+                       TokenRange sourceTokenStream,
+                       TokenRange targetTokenStream,
+                       std::vector<int> &targetIds);
+
   /// compareBetweenAnchors - Use the anchors to extract runs of tokens we 
-  ///                         wish to process with diff.
+  ///                         wish to process with diff. Gaps of at least 
+  ///                         anchorGap tokens are anchored again while depth
+  ///                         is below anchorDepth.
+  template <typename Index>
   std::list<DiffBlock> compareBetweenAnchors(
-      const std::vector<Token> &sourceTokenStream, 
-      const std::vector<Token> &targetTokenStream,
-      const std::vector<Anchor> &anchVector);
+      TokenRange sourceTokenStream, 
+      TokenRange targetTokenStream,
+      const std::vector<BasicAnchor<Index> > &anchVector, int depth = 0);
 
-  /// discardWhitespace
-  std::vector<Token> discardWhitespace(const std::vector<Token> &tokenStream);
+  /// discardWhitespace - Store the positions in tokenStream of its tokens 
+  ///                     that are not whitespace in positions, for a 
+  ///                     TokenRange that views them where they are. With 
+  ///                     ids, their ids are stored in it in the same pass.
+  void discardWhitespace(const std::vector<Token> &tokenStream,
+                         std::vector<int64_t> &positions,
+                         std::vector<int> *ids = 0);
 
   /// insertWhitespace - Add whitespace inforamtion back into the edit script.
   std::list<DiffBlock> insertWhitespace(
       const std::list<DiffBlock> &DBs, 
-      const std::vector<Token> &sourceTokenStream,
-      const std::vector<Token> &targetTokenStream);
+      TokenRange sourceTokenStream,
+      TokenRange targetTokenStream);
   
 //===--------------------------------------------------------------------===//
 // NDIFF PRIVATE STATIC HELPER FUNCTIONS 
 //===--------------------------------------------------------------------===//
 
-  /// mid - Returns a subvector that contains sequential tokens of a file, starting 
-  /// at the specified position pos. Returns an empty vector when the postion equals 
-  /// the file length.
-  static inline std::vector<Token> mid(const std::vector<Token>& v, int pos) {
-    return (pos == v.size()) ? std::vector<Token>() : 
-      std::vector<Token>(v.begin() + pos, v.end());
-  }
-
-  /// mid - Returns a subvector that contains len sequential tokens of a file, starting 
-  /// at the specified position pos. Returns an empty vector when the postion equals 
-  /// the file length.
-  static inline std::vector<Token> mid(const std::vector<Token> &v, int pos, int len) {
-    return (pos == v.size()) ? std::vector<Token>() : 
-      std::vector<Token>(v.begin() + pos, v.begin() + pos + len);
-  }
+  /// clipAnchors - Returns the parts of anchors that lie within both streams
+  /// once the first tokens of each are cut off and sourceSize and 
+  /// targetSize tokens are left, relative to the new starts.
+  template <typename Index>
+  static std::vector<BasicAnchor<Index> > clipAnchors(
+      const std::vector<BasicAnchor<Index> > &anchors, int64_t first, 
+      int64_t sourceSize, int64_t targetSize);
 
-  /// left - Returns a vector that contains the n leftmost tokens of the file. 
-  /// The entire vector is returned if n is greater than size() or less than zero.
-  static inline std::vector<Token> left(const std::vector<Token> &v, int n) {
-    return (n < 0 || v.size() < n) ? v : std::vector<Token>(v.begin(), v.begin() + n);
-  }
-
-  /// right - Returns a vector that contains the n rightmost tokens of the file. 
-  /// The entire vector is returned if n is greater than size() or less than zero.
-  static inline std::vector<Token> right(const std::vector<Token> &v, int n) {
-    return (n < 0 || v.size() < n) ? v : std::vector<Token>(v.end() - n, v.end());
-  }
+  /// directDifference - Store in DBs the difference of two runs of tokens 
+  /// that is plain without running diff: an insertion or deletion when one 
+  /// run is empty, or a substitution of a few tokens none of which the runs 
+  /// share. Returns false if diff has to be run.
+  static bool directDifference(TokenRange fromTokens,
+                               TokenRange toTokens,
+                               std::list<DiffBlock> &DBs);
 
   /// indexOf - Searches f0 for the first occurrence of the sequence defined 
   /// by f1, and returns the index position to its first element. 
-  static inline int indexOf(const std::vector<Token> &f0, 
-                            const std::vector<Token> &f1) {
+  static inline int64_t indexOf(const std::vector<Token> &f0, 
+                                const std::vector<Token> &f1) {
     std::vector<Token>::const_iterator i;
     i = std::search(f0.begin(), f0.end(), f1.begin(), f1.end());
     return (i == f0.end()) ? -1 : std::distance(f0.begin(), i);
@@ -102,9 +363,9 @@ private:
 
   /// indexOf - Searches f0 for the first occurrence of the sequence defined by f1, 
   /// starting at index pos and returns the index position to its first element.
-  static inline int indexOf(const std::vector<Token> &f0, 
-                            const std::vector<Token> &f1, 
-                            int pos) {
+  static inline int64_t indexOf(const std::vector<Token> &f0, 
+                                const std::vector<Token> &f1, 
+                                int64_t pos) {
     std::vector<Token>::const_iterator i;
     i = std::search(f0.begin() + pos, f0.end(), f1.begin(), f1.end());
     return (i == f0.end()) ? -1 : std::distance(f0.begin(), i);
@@ -0,0 +1,46 @@
+//===--- Parallel.h - Helpers for running work on threads -----*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines helpers for splitting work between threads.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/// runParallel - Run fn(t) for t in 0..threads-1, each on its own thread, and
+/// wait for all of them to finish. fn(0) runs on the calling thread.
+template <typename F>
+inline void runParallel(unsigned threads, F fn) {
+  std::vector<std::thread> workers;
+  for (unsigned t = 1; t < threads; ++t)
+    workers.push_back(std::thread(fn, t));
+  fn(0);
+  for (unsigned t = 0; t < workers.size(); ++t)
+    workers[t].join();
+}
+
+/// parallelFor - Run fn(i) for i in 0..n-1 on up to threads threads, or on 
+/// one per hardware thread when threads is 0. Items are handed out one at a 
+/// time, so items of very different cost still balance.
+template <typename F>
+inline void parallelFor(size_t n, unsigned threads, F fn) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = (unsigned)std::min<size_t>(threads, n);
+  std::atomic<size_t> next(0);
+  runParallel(threads, [&](unsigned) {
+    for (size_t i; (i = next++) < n;)
+      fn(i);
+  });
+}
+
+#endif // PARALLEL_H
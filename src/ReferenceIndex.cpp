@@ -0,0 +1,141 @@
+//===--- ReferenceIndex.cpp - Prebuilt suffix array of a file -------------===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the ReferenceIndex interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ReferenceIndex.h"
+#include "SuffixArray.h"
+#include "Token.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static const char Magic[8] = { 'N', 'D', 'I', 'F', 'F', 'I', 'D', 'X' };
+
+/// Written as is; reads back differently on a machine of the other byte order.
+static const uint32_t ByteOrderMark = 0x01020304;
+
+/// writeArray - Append n elements of data to out. Returns false on error.
+template <typename T>
+static bool writeArray(FILE *out, const T *data, size_t n) {
+  return n == 0 || fwrite(data, sizeof(T), n, out) == n;
+}
+
+bool ReferenceIndex::write(const std::string &path,
+                           TokenRange tokenStream,
+                           const std::map<std::string, int> &dictionary) {
+  const size_t n = tokenStream.size();
+  if (!fits(n))
+    return false;
+
+  // A suffix array of the reference with an empty target sorts the two
+  // sentinel suffixes first; the rest is the suffix array of the reference
+  // alone. Token ids start above the sentinels, so neither of them changes
+  // the LCPs of the others.
+  std::vector<int32_t> ids(n), SA(n), LCP(n);
+  int32_t maxLCP = 0;
+  {
+    const SuffixArray sa(tokenStream, TokenRange());
+    for (size_t i = 0; i < n; ++i) {
+      ids[i] = tokenStream[i].getHashValue();
+      SA[i] = sa.idxAt(i + 2);
+      LCP[i] = (i == 0) ? 0 : sa.lcpAt(i + 2);
+      maxLCP = std::max(maxLCP, LCP[i]);
+    }
+  }
+
+  std::vector<uint64_t> dictOffsets;
+  std::vector<int32_t> dictIds;
+  std::string dictText;
+  dictOffsets.reserve(dictionary.size() + 1);
+  dictIds.reserve(dictionary.size());
+  std::map<std::string, int>::const_iterator i(dictionary.begin()),
+                                             e(dictionary.end());
+  for (; i != e; ++i) {
+    dictOffsets.push_back(dictText.size());
+    dictIds.push_back(i->second);
+    dictText += i->first;
+  }
+  dictOffsets.push_back(dictText.size());
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.byteOrder = ByteOrderMark;
+  header.tokens = n;
+  header.dictionarySize = dictIds.size();
+  header.dictionaryBytes = dictText.size();
+  header.maxLCP = maxLCP;
+
+  FILE *out = fopen(path.c_str(), "wb");
+  if (!out)
+    return false;
+  bool ok = writeArray(out, &header, 1) &&
+            writeArray(out, dictOffsets.data(), dictOffsets.size()) &&
+            writeArray(out, ids.data(), n) &&
+            writeArray(out, SA.data(), n) &&
+            writeArray(out, LCP.data(), n) &&
+            writeArray(out, dictIds.data(), dictIds.size()) &&
+            writeArray(out, dictText.data(), dictText.size());
+  ok = (fclose(out) == 0) && ok;
+  if (!ok)
+    remove(path.c_str());
+  return ok;
+}
+
+bool ReferenceIndex::open(const std::string &path) {
+  header = 0;
+  if (!file.open(path))
+    return false;
+
+  const Header *h = reinterpret_cast<const Header *>(file.data());
+  if (file.size() < sizeof(Header) ||
+      memcmp(h->magic, Magic, sizeof(Magic)) != 0 ||
+      h->version != Version || h->byteOrder != ByteOrderMark ||
+      !fits(h->tokens)) {
+    file.close();
+    return false;
+  }
+
+  const uint64_t expected = sizeof(Header) +
+    (h->dictionarySize + 1) * sizeof(uint64_t) +
+    (3 * h->tokens + h->dictionarySize) * sizeof(int32_t) +
+    h->dictionaryBytes;
+  if (file.size() != expected) {
+    file.close();
+    return false;
+  }
+
+  header = h;
+  dictOffsets = reinterpret_cast<const uint64_t *>(header + 1);
+  ids = reinterpret_cast<const int32_t *>(dictOffsets + h->dictionarySize + 1);
+  SA = ids + h->tokens;
+  LCP = SA + h->tokens;
+  dictIds = LCP + h->tokens;
+  dictText = reinterpret_cast<const char *>(dictIds + h->dictionarySize);
+  return true;
+}
+
+int ReferenceIndex::lookup(const std::string &text) const {
+  // The dictionary is sorted the way std::string compares.
+  uint64_t lo = 0, hi = header->dictionarySize;
+  while (lo < hi) {
+    const uint64_t mid = lo + (hi - lo) / 2;
+    const int cmp = text.compare(0, std::string::npos, dictText + dictOffsets[mid],
+                                 dictOffsets[mid + 1] - dictOffsets[mid]);
+    if (cmp == 0)
+      return dictIds[mid];
+    if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return -1;
+}
@@ -0,0 +1,109 @@
+//===--- ReferenceIndex.h - Prebuilt suffix array of a file ---*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines the ReferenceIndex interface.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef REFERENCEINDEX_H
+#define REFERENCEINDEX_H
+
+#include "MappedFile.h"
+#include "TokenRange.h"
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// ReferenceIndex - The token ids, suffix array and LCP array of a reference
+/// file, stored in a file that is used through mmap as is. Comparing many
+/// files against the same reference can then skip sorting the reference's
+/// suffixes on every run.
+///
+/// The file holds, in native byte order:
+///   Header
+///   uint64_t dictionary offsets[dictionarySize + 1]
+///   int32_t  token ids[tokens]
+///   int32_t  suffix array[tokens]
+///   int32_t  LCPs[tokens]
+///   int32_t  dictionary ids[dictionarySize]
+///   char     dictionary text[dictionaryBytes]
+/// The dictionary lists the text of every distinct token in strcmp order
+/// together with its id.
+class ReferenceIndex {
+public:
+  /// Version - Bumped whenever the file format changes.
+  static const uint32_t Version = 1;
+
+  /// MaxTokens - The most tokens a reference may have. Offsets are stored in
+  /// 32 bits, and the suffix array is built with two sentinels and padding.
+  static const int64_t MaxTokens = INT32_MAX - 5;
+
+  /// fits - Returns true if a reference of the given number of tokens can be
+  /// indexed.
+  static bool fits(size_t tokens) { return tokens <= (size_t)MaxTokens; }
+
+private:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t tokens;
+    uint64_t dictionarySize;
+    uint64_t dictionaryBytes;
+    int32_t maxLCP;
+    uint32_t reserved;
+  };
+
+  MappedFile file;
+  const Header *header;
+  const uint64_t *dictOffsets;
+  const int32_t *ids, *SA, *LCP, *dictIds;
+  const char *dictText;
+
+  ReferenceIndex(const ReferenceIndex &);            // Do not implement.
+  ReferenceIndex &operator=(const ReferenceIndex &); // Do not implement.
+public:
+  ReferenceIndex()
+    : header(0), dictOffsets(0), ids(0), SA(0), LCP(0), dictIds(0),
+      dictText(0) {}
+
+  /// write - Build the index of the non-whitespace tokenStream, whose ids
+  /// were handed out according to dictionary, and store it at path. Returns
+  /// false if the file could not be written.
+  static bool write(const std::string &path,
+                    TokenRange tokenStream,
+                    const std::map<std::string, int> &dictionary);
+
+  /// open - Map the index stored at path. Returns false if the file is
+  /// missing, truncated, or was written by another version of ndiff.
+  bool open(const std::string &path);
+
+  /// isOpen - Returns true if an index is mapped.
+  bool isOpen() const { return header != 0; }
+
+  /// size - Returns the number of tokens in the reference.
+  int size() const { return (int)header->tokens; }
+
+  /// tokenIds - Returns the ids of the reference's tokens.
+  const int32_t *tokenIds() const { return ids; }
+
+  /// suffixArray - Returns the reference's suffixes in sorted order.
+  const int32_t *suffixArray() const { return SA; }
+
+  /// LCPs - Returns the length of the common prefix of every suffix in the
+  /// suffix array and the one before it, or 0 for the first.
+  const int32_t *LCPs() const { return LCP; }
+
+  /// maxLCP - Returns the length of the longest repeat in the reference.
+  int maxLCP() const { return header->maxLCP; }
+
+  /// lookup - Returns the id of the token with the given text, or -1 if the
+  /// reference does not contain it.
+  int lookup(const std::string &text) const;
+};
+
+#endif // REFERENCEINDEX_H
@@ -0,0 +1,105 @@
+//===--- SABench.cpp - Suffix array construction benchmark ----------------===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements a small driver that times each suffix array 
+//  construction algorithm on the token streams of two files, laid out exactly
+//  as AnchorAnalysis would sort them, and checks that the results agree.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SuffixArray.h"
+#include "Token.h"
+#include "TokenLexer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+
+/// Returns the wall clock time in seconds.
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/// Drop whitespace tokens the same way NDiff does before anchor analysis.
+static std::vector<Token> significantTokens(const std::vector<Token> &toks) {
+  std::vector<Token> result;
+  result.reserve(toks.size());
+  for (int i = 0, e = toks.size(); i < e; ++i)
+    if (!toks[i].isWhitespace())
+      result.push_back(toks[i]);
+  return result;
+}
+
+/// Lay out the index points of both streams the way SuffixArray::init does.
+static std::vector<int> indexPoints(const std::vector<Token> &source,
+                                    const std::vector<Token> &target) {
+  std::vector<int> result;
+  result.reserve(source.size() + target.size() + 2);
+  for (int i = 0, e = source.size(); i < e; ++i)
+    result.push_back(source[i].getHashValue());
+  result.push_back(0); // Sentinel.
+  for (int i = 0, e = target.size(); i < e; ++i)
+    result.push_back(target[i].getHashValue());
+  result.push_back(1); // Sentinel.
+  return result;
+}
+
+/// Sort the suffixes reps times and return the fastest time.
+static double timeConstruction(const std::vector<int> &text,
+                               SuffixArray::Construction algorithm, 
+                               int reps, unsigned threads,
+                               std::vector<int> &result) {
+  double best = 0;
+  for (int i = 0; i < reps; ++i) {
+    const double start = now();
+    std::vector<int> SA(SuffixArray::sortSuffixes(text, algorithm, threads));
+    const double elapsed = now() - start;
+    if (i == 0 || elapsed < best)
+      best = elapsed;
+    if (i == 0)
+      result.swap(SA);
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: sabench source target [repetitions [threads]]\n");
+    return 2;
+  }
+  const int reps = (argc > 3) ? std::max(1, atoi(argv[3])) : 5;
+  const unsigned threads = (argc > 4) ? std::max(0, atoi(argv[4])) : 0;
+
+  TokenLexer theTokenLexer;
+  const std::vector<Token> source(
+      significantTokens(theTokenLexer.tokenize(argv[1])));
+  const std::vector<Token> target(
+      significantTokens(theTokenLexer.tokenize(argv[2])));
+  printf("%d + %d tokens, best of %d runs\n", 
+         (int)source.size(), (int)target.size(), reps);
+
+  const std::vector<int> text(indexPoints(source, target));
+  std::vector<int> dc3, sais, parallel;
+  const double dc3Time = timeConstruction(text, SuffixArray::DC3Construction, 
+                                          reps, threads, dc3);
+  const double saisTime = timeConstruction(text, SuffixArray::SAISConstruction,
+                                           reps, threads, sais);
+  const double parallelTime = timeConstruction(text, 
+      SuffixArray::ParallelConstruction, reps, threads, parallel);
+
+  printf("DC3:      %10.3f ms\n", dc3Time * 1e3);
+  printf("SA-IS:    %10.3f ms  (%.2fx)\n", saisTime * 1e3, 
+         saisTime > 0 ? dc3Time / saisTime : 0.0);
+  printf("Parallel: %10.3f ms  (%.2fx)\n", parallelTime * 1e3, 
+         parallelTime > 0 ? dc3Time / parallelTime : 0.0);
+  if (dc3 != sais || dc3 != parallel) {
+    printf("error: suffix arrays differ\n");
+    return 1;
+  }
+  return 0;
+}
@@ -9,167 +9,540 @@
 //===----------------------------------------------------------------------===//
 
 #include "SuffixArray.h"
+#include "Parallel.h"
 #include "Token.h"
 #include <cstdio>
 
-void SuffixArray::init(const std::vector<Token> sourceTokenStream,
-                       const std::vector<Token> targetTokenStream) {
+/// Inputs with at least this many index points are sorted in parallel by
+/// AutomaticConstruction. Below it SA-IS on one thread wins.
+static const int ParallelThreshold = 1 << 22;
+
+/// AutomaticConstruction only goes parallel with at least this many threads,
+/// which is roughly where parallel DC3 overtakes sequential SA-IS.
+static const unsigned ParallelMinThreads = 4;
+
+/// DC3 recursion levels and radix passes smaller than this run on a single 
+/// thread; starting threads would cost more than it saves.
+static const int ParallelGrain = 1 << 16;
+
+/// remapAlphabet ranks the index points with a table indexed by the old 
+/// index points as long as it holds at most this many entries per index 
+/// point, and by sorting the distinct index points otherwise.
+static const int RankTableFactor = 4;
+
+template <typename Index>
+void 
+BasicSuffixArray<Index>::init(TokenRange sourceTokenStream, 
+                              TokenRange targetTokenStream,
+                              Construction algorithm) {
+  std::vector<Index> indexPoints;
+  indexPoints.reserve(sourceTokenStream.size() + targetTokenStream.size() + 5);
+  for (size_t j = 0, e = sourceTokenStream.size(); j != e; ++j)
+    indexPoints.push_back(sourceTokenStream[j].getHashValue());
+  indexPoints.push_back(0); // Sentinel.
+  for (size_t j = 0, e = targetTokenStream.size(); j != e; ++j)
+    indexPoints.push_back(targetTokenStream[j].getHashValue());
+  indexPoints.push_back(1); // Sentinel.
+  build(indexPoints, algorithm);
+}
+
+template <typename Index>
+void 
+BasicSuffixArray<Index>::init(const std::vector<TokenRange> &tokenStreams,
+                              Construction algorithm) {
   // Assign index points to the tokens. Index points are assigned 
   // token by token and hence we can search with the suffix array 
-  // at any positions later.
-  const int size = sourceTokenStream.size() + targetTokenStream.size() + 2;
-  std::vector<int> indexPoints;
-  indexPoints.reserve(size);
-  for (int i = 0; i < 2; ++i) {
-    std::vector<Token> tokStream = (i==0) ? sourceTokenStream : targetTokenStream;
-    for (int j = 0, e = tokStream.size(); j != e; ++j)
+  // at any positions later. DC3 pads the text, so leave room for it.
+  Index size = tokenStreams.size();
+  for (size_t i = 0; i != tokenStreams.size(); ++i)
+    size += tokenStreams[i].size();
+  std::vector<Index> indexPoints;
+  indexPoints.reserve(size + 3);
+  for (Index i = 0, e = tokenStreams.size(); i != e; ++i) {
+    const TokenRange tokStream = tokenStreams[i];
+    for (Index j = 0, e = tokStream.size(); j != e; ++j)
       indexPoints.push_back(tokStream[j].getHashValue());
     indexPoints.push_back(i); // Sentinel.
   }
-  // Run DC3 and compute the lcp array.
-  // DC3 requires at least 3 elements of padding at the end.
-  indexPoints.resize(size + 3, 0);  
-  orderedIdxPoints = DC3(indexPoints);
+  build(indexPoints, algorithm);
+}
+
+template <typename Index>
+void BasicSuffixArray<Index>::build(std::vector<Index> &text, 
+                                    Construction algorithm) {
+  // Sort the suffixes and compute the lcp array. The LCPs only compare index 
+  // points for equality, so the remapped text serves as well as the 
+  // original. It is consumed by the computation.
+  orderedIdxPoints = sortText(text, algorithm, 0, 0);
+  lcps = computeLCPs(text, orderedIdxPoints);
+}
+
+template <typename Index>
+std::vector<Index> 
+BasicSuffixArray<Index>::sortSuffixes(std::vector<Index> indexPoints,
+                                      Construction algorithm,
+                                      unsigned threads,
+                                      Workspace *workspace) {
+  return sortText(indexPoints, algorithm, threads, workspace);
+}
+
+template <typename Index>
+std::vector<Index> 
+BasicSuffixArray<Index>::sortText(std::vector<Index> &indexPoints,
+                                  Construction algorithm,
+                                  unsigned threads,
+                                  Workspace *workspace) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  if (algorithm == AutomaticConstruction)
+    algorithm = ((Index)indexPoints.size() >= ParallelThreshold && 
+                 threads >= ParallelMinThreads) ? 
+      ParallelConstruction : SAISConstruction;
+
+  if (algorithm == SAISConstruction) {
+    const Index K = remapAlphabet(indexPoints, 0);
+    return SAIS(indexPoints, K);
+  }
 
-  // Drop padding.
-  indexPoints.resize(size);
+  // Every thread that calls in here gets a workspace of its own, which is 
+  // kept for the next suffix array the thread builds.
+  static thread_local Workspace threadWorkspace;
+  if (!workspace)
+    workspace = &threadWorkspace;
 
-  // Compute the lcps
-  lcps = computeLCPs(indexPoints, orderedIdxPoints);
-  orderedlcps = orderLCPs(lcps);
+  // DC3 requires at least 3 elements of padding at the end. The text itself
+  // starts at 1 so that no index point equals the padding.
+  remapAlphabet(indexPoints, 1);
+  indexPoints.resize(indexPoints.size() + 3, 0);  
+  std::vector<Index> result(DC3(indexPoints, 
+                                algorithm == ParallelConstruction ? threads : 1,
+                                *workspace));
+  indexPoints.resize(indexPoints.size() - 3);
+  return result;
 }
 
-std::vector<int> SuffixArray::DC3(std::vector<int> indexPoints) {
-  int n = indexPoints.size() - 3;
-  int max = *std::max_element(indexPoints.begin(), indexPoints.end());
-  std::vector<int> result;
+template <typename Index>
+std::vector<Index> 
+BasicSuffixArray<Index>::DC3(const std::vector<Index> &indexPoints, 
+                             unsigned threads, Workspace &workspace) {
+  Index n = indexPoints.size() - 3;
+  Index max = *std::max_element(indexPoints.begin(), indexPoints.end());
+  std::vector<Index> result;
   result.resize(n);
-  DC3(&indexPoints[0], &result[0], n, max);
+
+  // Grow the workspace if this input needs more than any before it.
+  const size_t size = DC3WorkspaceSize(n);
+  if (workspace.buffer.size() < size)
+    workspace.buffer.resize(size);
+  if (workspace.radix.size() < 3 * (size_t)n)
+    workspace.radix.resize(3 * (size_t)n);
+  if (workspace.counters.size() < threads * RadixCounters)
+    workspace.counters.resize(threads * RadixCounters);
+
+  DC3(&indexPoints[0], &result[0], n, max, threads, 
+      &workspace.buffer[0], workspace);
   return result;
 }
 
-void SuffixArray::DC3(int* s, int* SA, int n, int K) {
-	int n0=(n+2)/3, n1=(n+1)/3, n2=n/3, n02=n0+n2; 
-	int* s12  = new int[n02 + 3];  s12[n02]= s12[n02+1]= s12[n02+2]=0; 
-	int* SA12 = new int[n02 + 3]; SA12[n02]=SA12[n02+1]=SA12[n02+2]=0;
-	int* s0   = new int[n0];
-	int* SA0  = new int[n0];
+template <typename Index>
+size_t BasicSuffixArray<Index>::DC3WorkspaceSize(Index n) {
+  size_t size = 0;
+  for (;;) {
+    const Index n0 = (n + 2) / 3, n2 = n / 3, n02 = n0 + n2;
+    // s12 and SA12 with padding, s0 and SA0.
+    size += 2 * (n02 + 3) + 2 * n0;
+    if (n02 >= n) 
+      return size;
+    n = n02;
+  }
+}
+
+template <typename Index>
+void BasicSuffixArray<Index>::DC3(const Index* s, Index* SA, Index n, Index K, 
+                                  unsigned threads, Index *work, 
+                                  Workspace &workspace) {
+	Index n0=(n+2)/3, n1=(n+1)/3, n2=n/3, n02=n0+n2; 
+	if (n < ParallelGrain) threads = 1;
+
+	// carve this level's arrays out of the workspace; the recursion works in
+	// whatever follows them
+	Index* s12  = work;             s12[n02]= s12[n02+1]= s12[n02+2]=0; 
+	Index* SA12 = s12 + n02 + 3;   SA12[n02]=SA12[n02+1]=SA12[n02+2]=0;
+	Index* s0   = SA12 + n02 + 3;
+	Index* SA0  = s0 + n0;
+	Index* next = SA0 + n0;
 
 	// generate positions of mod 1 and mod  2 suffixes
 	// the "+(n0-n1)" adds a dummy mod 1 suffix if n%3 == 1
-	for (int i=0, j=0; i < n + (n0 - n1);  i++) 
+	for (Index i=0, j=0; i < n + (n0 - n1);  i++) 
     if (i%3 != 0) 
       s12[j++] = i;
 
 	// lsb radix sort the mod 1 and mod 2 triples
-	radixPass(s12 , SA12, s+2, n02, K);
-	radixPass(SA12, s12 , s+1, n02, K);  
-	radixPass(s12 , SA12, s  , n02, K);
-
-	// find lexicographic names of triples
-	int name = 0, c0 = -1, c1 = -1, c2 = -1;
-	for (int i = 0;  i < n02;  i++) {
-		if (s[SA12[i]] != c0 || s[SA12[i]+1] != c1 || s[SA12[i]+2] != c2) { 
-			name++;  
-      c0 = s[SA12[i]];  
-      c1 = s[SA12[i]+1];  
-      c2 = s[SA12[i]+2];
-		}
-		if (SA12[i] % 3 == 1) { // left half
-      s12[SA12[i]/3] = name; 
-    } else { // right half
-      s12[SA12[i]/3 + n0] = name; 
-    } 
+	radixPass(s12 , SA12, s+2, n02, K, threads, workspace);
+	radixPass(SA12, s12 , s+1, n02, K, threads, workspace);  
+	radixPass(s12 , SA12, s  , n02, K, threads, workspace);
+
+	// find lexicographic names of triples. Every thread names one slice of 
+	// SA12. With more than one thread, a first pass counts the new names in 
+	// each slice so that every slice knows the name it starts from. The 
+	// radix counters are idle until the next pass and hold the name counts.
+	const Index slice = (n02 + threads - 1) / threads;
+	Index* names = &workspace.counters[0];
+	Index* lastNames = names + threads + 1;
+	std::fill(names, names + threads + 1, 0);
+	const auto newName = [=](Index i) {
+		return i == 0 || s[SA12[i]] != s[SA12[i-1]] || 
+		       s[SA12[i]+1] != s[SA12[i-1]+1] || s[SA12[i]+2] != s[SA12[i-1]+2];
+	};
+	if (threads > 1) {
+		runParallel(threads, [&](unsigned t) {
+			for (Index i = std::min(n02, (Index)t * slice), e = std::min(n02, i + slice);
+			     i < e; i++) 
+				names[t + 1] += newName(i);
+		});
+		for (unsigned t = 0; t < threads; t++) names[t + 1] += names[t];
 	}
+	runParallel(threads, [&](unsigned t) {
+		Index name = names[t];
+		for (Index i = std::min(n02, (Index)t * slice), e = std::min(n02, i + slice);
+		     i < e; i++) {
+			if (newName(i)) name++;
+			if (SA12[i] % 3 == 1) { // left half
+				s12[SA12[i]/3] = name; 
+			} else { // right half
+				s12[SA12[i]/3 + n0] = name; 
+			}
+		}
+		lastNames[t] = name;
+	});
+	Index name = lastNames[threads - 1];
 
 	// recurse if names are not yet unique
 	if (name < n02) {
-		DC3(s12, SA12, n02, name);
+		DC3(s12, SA12, n02, name, threads, next, workspace);
 		// store unique names in s12 using the suffix array 
-		for (int i = 0;  i < n02;  i++) s12[SA12[i]] = i + 1;
+		for (Index i = 0;  i < n02;  i++) s12[SA12[i]] = i + 1;
 	} else // generate the suffix array of s12 directly
-		for (int i = 0;  i < n02;  i++) SA12[s12[i] - 1] = i; 
+		for (Index i = 0;  i < n02;  i++) SA12[s12[i] - 1] = i; 
 
 	// stably sort the mod 0 suffixes from SA12 by their first character
-	for (int i=0, j=0;  i < n02;  i++) if (SA12[i] < n0) s0[j++] = 3*SA12[i];
-	radixPass(s0, SA0, s, n0, K);
-
-	// merge sorted SA0 suffixes and sorted SA12 suffixes
-	for (int p=0,  t=n0-n1,  k=0;  k < n;  k++) {
-#define GetI() (SA12[t] < n0 ? SA12[t] * 3 + 1 : (SA12[t] - n0) * 3 + 2)
-		int i = GetI(); // pos of current offset 12 suffix
-		int j = SA0[p]; // pos of current offset 0  suffix
-		if (SA12[t] < n0 ? 
-				leq(s[i],       s12[SA12[t] + n0], s[j],       s12[j/3]) :
-				leq(s[i],s[i+1],s12[SA12[t]-n0+1], s[j],s[j+1],s12[j/3+n0]))
-		{ // suffix from SA12 is smaller
-			SA[k] = i;  t++;
-			if (t == n02) { // done --- only SA0 suffixes left
-				for (k++;  p < n0;  p++, k++) SA[k] = SA0[p];
-			}
-		} else { 
-			SA[k] = j;  p++; 
-			if (p == n0)  { // done --- only SA12 suffixes left
-				for (k++;  t < n02;  t++, k++) SA[k] = GetI(); 
+	for (Index i=0, j=0;  i < n02;  i++) if (SA12[i] < n0) s0[j++] = 3*SA12[i];
+	radixPass(s0, SA0, s, n0, K, threads, workspace);
+
+	// merge sorted SA0 suffixes and sorted SA12 suffixes. Every thread fills
+	// one slice of SA, starting from the point where the merge path crosses
+	// into it. The "n0-n1" skips the dummy mod 1 suffix.
+	const Index first12 = n0 - n1, nA = n02 - first12, nB = n0;
+	const auto pos12 = [=](Index t) { // pos of offset 12 suffix SA12[t]
+		return SA12[t] < n0 ? SA12[t] * 3 + 1 : (SA12[t] - n0) * 3 + 2;
+	};
+	const auto before = [=](Index t, Index p) { // SA12[t] sorts before SA0[p]
+		const Index i = pos12(t), j = SA0[p];
+		return SA12[t] < n0 ? 
+			leq(s[i],       s12[SA12[t] + n0], s[j],       s12[j/3]) :
+			leq(s[i],s[i+1],s12[SA12[t]-n0+1], s[j],s[j+1],s12[j/3+n0]);
+	};
+	const Index outSlice = (n + threads - 1) / threads;
+	runParallel(threads, [&](unsigned th) {
+		Index k = std::min(n, (Index)th * outSlice), e = std::min(n, k + outSlice);
+		Index lo = std::max((Index)0, k - nB), hi = std::min(k, nA);
+		while (lo < hi) {
+			const Index mid = (lo + hi) / 2;
+			if (before(first12 + mid, k - mid - 1)) lo = mid + 1; 
+			else hi = mid;
+		}
+		for (Index t = first12 + lo, p = k - lo;  k < e;  k++) {
+			if (p == n0 || (t < n02 && before(t, p))) { // suffix from SA12 is smaller
+				SA[k] = pos12(t);  t++;
+			} else { 
+				SA[k] = SA0[p];  p++; 
 			}
-		}  
-	} 
-	delete [] s12; delete [] SA12; delete [] SA0; delete [] s0; 
+		}
+	});
 }
 
-void SuffixArray::radixPass(int* a, int* b, int* r, int n, int K) {
-  int* c = new int[K + 1];                          // counter array
-  for (int i = 0;  i <= K;  i++) c[i] = 0;         // reset counters
-  for (int i = 0;  i < n;  i++) c[r[a[i]]]++;    // count occurences
-  for (int i = 0, sum = 0;  i <= K;  i++) { // exclusive prefix sums
-     int t = c[i];  c[i] = sum;  sum += t;
+template <typename Index>
+Index BasicSuffixArray<Index>::remapAlphabet(std::vector<Index> &indexPoints, 
+                                             Index first) {
+  const Index n = indexPoints.size();
+  if (n == 0)
+    return first;
+  const Index max = *std::max_element(indexPoints.begin(), indexPoints.end());
+
+  // Usually the index points are few enough that we can mark the ones that
+  // occur in a table and number them in a single sweep over it.
+  if ((size_t)max < RankTableFactor * (size_t)n) {
+    std::vector<Index> rank(max + 1, -1);
+    for (Index i = 0; i < n; ++i)
+      rank[indexPoints[i]] = 0;
+    Index next = first;
+    for (Index c = 0; c <= max; ++c)
+      if (rank[c] == 0) 
+        rank[c] = next++;
+    for (Index i = 0; i < n; ++i)
+      indexPoints[i] = rank[indexPoints[i]];
+    return next;
   }
-  for (int i = 0;  i < n;  i++) b[c[r[a[i]]]++] = a[i];      // sort
-  delete [] c;
+
+  std::vector<Index> alphabet(indexPoints);
+  std::sort(alphabet.begin(), alphabet.end());
+  alphabet.erase(std::unique(alphabet.begin(), alphabet.end()), alphabet.end());
+  for (Index i = 0; i < n; ++i)
+    indexPoints[i] = first + (std::lower_bound(alphabet.begin(), 
+                                               alphabet.end(), indexPoints[i]) - 
+                              alphabet.begin());
+  return first + alphabet.size();
 }
 
-std::vector<int> SuffixArray::computeLCPs(const std::vector<int> &indexPoints,
-                                          const std::vector<int> &orderedIdxPoints) {
-  const int n = indexPoints.size();
-  std::vector<int> LCPs(n);
-
-  // Initilaze the rank array. 
-	std::vector<int> rank(n);
-	for (int i = 0, e = n; i < e; ++i)
-		rank[orderedIdxPoints[i]] = i;
-
-	int h = 0;
-	for (int i = 0, e = n; i < e; ++i) {
-		int k = rank[i];
-		if (k == 0) {
-			LCPs[k] = 0;
-    } else {
-			int j = orderedIdxPoints[k - 1];
-			while (i+h <= n && 
-             j+h <= n && 
-             indexPoints[i+h] == indexPoints[j+h]) 
-        h++;
-			LCPs[k] = h;
-		}
-		if (h > 0) 
-      h--;
-	}
-  return LCPs;
+template <typename Index>
+std::vector<Index> 
+BasicSuffixArray<Index>::SAIS(const std::vector<Index> &indexPoints, Index K) {
+  const Index n = indexPoints.size();
+  std::vector<Index> result(n);
+  if (K <= NarrowAlphabet) {
+    // Half the memory traffic for the text. The reduced problems may have 
+    // more names than that and keep using Index.
+    const std::vector<unsigned short> text(indexPoints.begin(), 
+                                           indexPoints.end());
+    SAIS(&text[0], &result[0], n, K);
+  } else {
+    SAIS(&indexPoints[0], &result[0], n, K);
+  }
+  return result;
+}
+
+template <typename Index> template <typename Char>
+void BasicSuffixArray<Index>::SAIS(const Char *s, Index *SA, Index n, Index K) {
+  if (n == 1) { 
+    SA[0] = 0; 
+    return; 
+  }
+
+  // Classify every suffix as S-type (smaller than its right neighbour) or 
+  // L-type (larger). The suffix holding only the last character is L-type 
+  // since it is larger than the empty suffix at the virtual sentinel.
+  std::vector<bool> stype(n);
+  stype[n - 1] = false;
+  for (Index i = n - 2; i >= 0; --i)
+    stype[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && stype[i + 1]);
+
+  std::vector<Index> bucketSizes(K, 0), bucket(K);
+  for (Index i = 0; i < n; ++i) 
+    ++bucketSizes[s[i]];
+
+  // Stage 1: sort the LMS substrings. Put every LMS position at the end of 
+  // its bucket in text order and let induced sorting do the rest.
+  std::fill(SA, SA + n, -1);
+  for (Index c = 0, sum = 0; c < K; ++c) { 
+    sum += bucketSizes[c]; 
+    bucket[c] = sum; 
+  }
+  for (Index i = 1; i < n; ++i) 
+    if (isLMS(stype, i)) 
+      SA[--bucket[s[i]]] = i;
+  induceSAIS(s, SA, n, stype, bucketSizes);
+
+  // Compact the now sorted LMS positions into the front of SA. No two LMS 
+  // positions are adjacent, so there are at most n/2 of them.
+  Index m = 0;
+  for (Index i = 0; i < n; ++i) 
+    if (isLMS(stype, SA[i])) 
+      SA[m++] = SA[i];
+
+  // Name the LMS substrings. Equal substrings get equal names. Names are 
+  // parked at SA[m + pos/2], which is unique for every LMS position.
+  std::fill(SA + m, SA + n, -1);
+  Index name = 0;
+  for (Index i = 0, prev = -1; i < m; ++i) {
+    const Index pos = SA[i];
+    bool equal = prev >= 0;
+    for (Index d = 0; equal; ++d) {
+      // The virtual sentinel only ever equals itself.
+      if (prev + d == n || pos + d == n || s[prev + d] != s[pos + d] || 
+          stype[prev + d] != stype[pos + d]) {
+        equal = false;
+      } else if (d > 0 && (isLMS(stype, prev + d) || isLMS(stype, pos + d))) {
+        equal = isLMS(stype, prev + d) && isLMS(stype, pos + d);
+        break;
+      }
+    }
+    if (!equal) { 
+      ++name; 
+      prev = pos; 
+    }
+    SA[m + pos / 2] = name - 1;
+  }
+
+  // Gather the names in text order to form the reduced string s1, stored at 
+  // the tail of SA. Its suffix array SA1 goes into the front of SA.
+  for (Index i = n - 1, j = n - 1; i >= m; --i) 
+    if (SA[i] >= 0) 
+      SA[j--] = SA[i];
+  Index *s1 = SA + n - m, *SA1 = SA;
+
+  // Stage 2: sort the LMS suffixes. Recurse if names are not yet unique.
+  if (name < m) {
+    SAIS(s1, SA1, m, name);
+  } else {
+    for (Index i = 0; i < m; ++i) 
+      SA1[s1[i]] = i;
+  }
+
+  // Stage 3: induce the full suffix array from the sorted LMS suffixes.
+  // Reuse s1 to map reduced string positions back to text positions.
+  for (Index i = 1, j = 0; i < n; ++i) 
+    if (isLMS(stype, i)) 
+      s1[j++] = i;
+  for (Index i = 0; i < m; ++i) 
+    SA1[i] = s1[SA1[i]];
+  std::fill(SA + m, SA + n, -1);
+  for (Index c = 0, sum = 0; c < K; ++c) { 
+    sum += bucketSizes[c]; 
+    bucket[c] = sum; 
+  }
+  for (Index i = m - 1; i >= 0; --i) {
+    const Index j = SA[i];
+    SA[i] = -1;
+    SA[--bucket[s[j]]] = j;
+  }
+  induceSAIS(s, SA, n, stype, bucketSizes);
+}
+
+template <typename Index> template <typename Char>
+void BasicSuffixArray<Index>::induceSAIS(const Char *s, Index *SA, Index n, 
+                                         const std::vector<bool> &stype,
+                                         const std::vector<Index> &bucketSizes) {
+  const Index K = bucketSizes.size();
+  std::vector<Index> bucket(K);
+
+  // L-type suffixes are induced left to right from the bucket heads. The 
+  // suffix preceding the virtual sentinel comes first.
+  for (Index c = 0, sum = 0; c < K; ++c) { 
+    bucket[c] = sum; 
+    sum += bucketSizes[c]; 
+  }
+  SA[bucket[s[n - 1]]++] = n - 1;
+  for (Index i = 0; i < n; ++i) {
+    const Index j = SA[i] - 1;
+    if (j >= 0 && !stype[j]) 
+      SA[bucket[s[j]]++] = j;
+  }
+
+  // S-type suffixes are induced right to left from the bucket tails.
+  for (Index c = 0, sum = 0; c < K; ++c) { 
+    sum += bucketSizes[c]; 
+    bucket[c] = sum; 
+  }
+  for (Index i = n - 1; i >= 0; --i) {
+    const Index j = SA[i] - 1;
+    if (j >= 0 && stype[j]) 
+      SA[--bucket[s[j]]] = j;
+  }
+}
+
+template <typename Index>
+void BasicSuffixArray<Index>::radixPass(Index* a, Index* b, const Index* r, 
+                                        Index n, Index K, 
+                                        unsigned threads, Workspace &workspace) {
+  // A counter array covering all of 0..K stops fitting in the cache once K 
+  // gets large, and one per thread would multiply the work of clearing it. 
+  // Keys wider than RadixDigitBits are therefore sorted on balanced digits,
+  // least significant first. The first pass gathers every key next to its 
+  // value so that later passes stream through memory instead of looking 
+  // the keys up in r again. The passes alternate between the scratch arrays
+  // and b such that the last one writes to b.
+  Index keyBits = 1;
+  while (keyBits < std::numeric_limits<Index>::digits && (K >> keyBits) != 0) 
+    ++keyBits;
+  const Index passes = (keyBits + RadixDigitBits - 1) / RadixDigitBits;
+  const Index bits = (keyBits + passes - 1) / passes, radix = 1 << bits;
+  if (n < ParallelGrain) 
+    threads = 1;
+
+  Index *counters = &workspace.counters[0];
+  Index *values[2] = { &workspace.radix[0], b };
+  Index *keys[2] = { &workspace.radix[n], &workspace.radix[2 * n] };
+  const Index slice = (n + threads - 1) / threads;
+  for (Index pass = 0; pass < passes; ++pass) {
+    const Index *src = (pass == 0) ? a : values[(passes - pass) % 2 == 0];
+    const Index *srcKeys = (pass == 0) ? 0 : keys[(passes - pass) % 2 == 0];
+    Index *dst = values[(passes - 1 - pass) % 2 == 0];
+    Index *dstKeys = keys[(passes - 1 - pass) % 2 == 0];
+    const bool last = pass == passes - 1;
+    const Index shift = pass * bits;
+    const auto key = [=](Index i) { return srcKeys ? srcKeys[i] : r[src[i]]; };
+
+    // Count the digits in each thread's slice of the input.
+    runParallel(threads, [&](unsigned t) {
+      Index *c = counters + t * radix;
+      std::fill(c, c + radix, 0);
+      for (Index i = std::min(n, (Index)t * slice), e = std::min(n, i + slice); 
+           i < e; ++i)
+        c[(key(i) >> shift) & (radix - 1)]++;
+    });
+    // Exclusive prefix sums, ordered by digit and then by thread so that 
+    // the pass stays stable.
+    for (Index d = 0, sum = 0; d < radix; ++d) {
+      for (unsigned t = 0; t < threads; ++t) {
+        const Index c = counters[t * radix + d];
+        counters[t * radix + d] = sum;
+        sum += c;
+      }
+    }
+    runParallel(threads, [&](unsigned t) {
+      Index *c = counters + t * radix;
+      for (Index i = std::min(n, (Index)t * slice), e = std::min(n, i + slice); 
+           i < e; ++i) {
+        const Index k = key(i), j = c[(k >> shift) & (radix - 1)]++;
+        dst[j] = src[i];
+        if (!last) 
+          dstKeys[j] = k;
+      }
+    });
+  }
 }
 
-std::vector<int> SuffixArray::orderLCPs(const std::vector<int> &LCPs) {
-  const int n = LCPs.size();
-  std::vector<int> longestFirstLCPs;
-  longestFirstLCPs.reserve(n);
-
-  // We can reduce the overhead of sorting the entire vector of lcp values by 
-  // eliminating small values below some threshold. Also, in practice we notice
-  // that a bulk of the values are 0, which are worthless to keep anyway.
-  const int cutoff = 1;
-  for (int i = 0; i < n; ++i)
-    if (LCPs[i] > cutoff) 
-      longestFirstLCPs.push_back(LCPs[i]);
-	std::sort(longestFirstLCPs.begin(), longestFirstLCPs.end());
-  return longestFirstLCPs;
+template <typename Index>
+std::vector<Index> 
+BasicSuffixArray<Index>::computeLCPs(std::vector<Index> &indexPoints,
+                                     const std::vector<Index> &orderedIdxPoints) {
+  const Index n = indexPoints.size();
+  if (n == 0)
+    return std::vector<Index>();
+
+  // Phi maps every suffix to the suffix preceding it in the suffix array.
+  // The first suffix has no predecessor.
+  std::vector<Index> PLCP(n);
+  PLCP[orderedIdxPoints[0]] = -1;
+  for (Index i = 1; i < n; ++i)
+    PLCP[orderedIdxPoints[i]] = orderedIdxPoints[i - 1];
+
+  // Replace Phi by the permuted LCP array in text order. The LCP of suffix 
+  // i+1 is at least that of suffix i minus one, so h never drops by more 
+  // than one and the whole loop is linear.
+  Index h = 0;
+  for (Index i = 0; i < n; ++i) {
+    const Index j = PLCP[i];
+    if (j < 0) {
+      h = 0;
+    } else {
+      while (i + h < n && j + h < n && indexPoints[i + h] == indexPoints[j + h])
+        ++h;
+    }
+    PLCP[i] = h;
+    if (h > 0) 
+      --h;
+  }
+
+  // The text is no longer needed; put the LCPs in suffix array order into 
+  // its storage.
+  std::vector<Index> LCPs;
+  LCPs.swap(indexPoints);
+  for (Index k = 0; k < n; ++k)
+    LCPs[k] = PLCP[orderedIdxPoints[k]];
+  return LCPs;
 }
 
+template class BasicSuffixArray<int>;
+template class BasicSuffixArray<int64_t>;
@@ -11,62 +11,155 @@
 #ifndef SUFFIXARRAY_H
 #define SUFFIXARRAY_H
 
+#include "TokenRange.h"
 #include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdint.h>
 #include <vector>
 
 class Token;
 
+/// SuffixArrayBase - What every instantiation of BasicSuffixArray shares,
+/// independent of its index type.
+class SuffixArrayBase {
+public:
+  /// Construction - The algorithms available for sorting the suffixes. All
+  /// of them produce exactly the same suffix array.
+  enum Construction {
+    DC3Construction,      // Karkkainen-Sanders-Burkhardt difference cover.
+    SAISConstruction,     // Nong-Zhang-Chan induced sorting.
+    ParallelConstruction, // Multi-threaded DC3.
+    AutomaticConstruction // SA-IS, or parallel DC3 for large inputs on 
+                          // machines with enough cores.
+  };
+};
+
 /// The SuffixArray data structure is the sorted order of suffixes with pairwise 
 /// LCPs of neighboring suffixes. Suffix arrays help lookup of any substring of 
 /// a text and indentification of repeated substrings. And it is more compact 
 /// than a suffix tree and suitable for storing in secondary memory.
-class SuffixArray {
+///
+/// Index is the signed integer type of index points, offsets and lengths. 
+/// It bounds the number of tokens a suffix array can hold; 32-bit indices 
+/// take half the memory bandwidth of 64-bit ones and should be used whenever
+/// the input fits (see fits).
+template <typename Index>
+class BasicSuffixArray : public SuffixArrayBase {
+public:
+  /// Workspace - Scratch memory for DC3. One workspace serves every level of
+  /// the recursion and can be reused for any number of suffix arrays, so 
+  /// that DC3 itself never allocates. It only grows when a larger input 
+  /// comes along.
+  class Workspace {
+    friend class BasicSuffixArray;
+
+    /// Arrays of every recursion level, carved out front to back.
+    std::vector<Index> buffer;
+
+    /// Radix pass scratch: the values and keys of multi-digit passes. Only
+    /// one radix pass runs at a time, so all levels share it.
+    std::vector<Index> radix;
+
+    /// Radix pass counters, one digit-sized array per thread.
+    std::vector<Index> counters;
+  public:
+    Workspace() {}
+
+    /// release - Free the memory held by this workspace.
+    void release() {
+      std::vector<Index>().swap(buffer);
+      std::vector<Index>().swap(radix);
+      std::vector<Index>().swap(counters);
+    }
+  };
+
+private:
   /// orderedIdxPoints - Vector of integers specifying the lexicographic ordering of 
   ///                      the suffixes
-  std::vector<int> orderedIdxPoints;
+  std::vector<Index> orderedIdxPoints;
     
   /// lcps - This is the list of pairwise longest common prefixes 
   ///            of neighboring suffixes.
-  std::vector<int> lcps;
-
-  /// orderedlcps - This is the list of pairwise longest common prefixes 
-  ///                   of neighboring suffixes after they have been sorted.
-  std::vector<int> orderedlcps;
+  std::vector<Index> lcps;
 public:
   /// Create a SuffixArray for the specified token streams.
-  SuffixArray(const std::vector<Token> sourceTokenStream,
-              const std::vector<Token> targetTokenStream) {
-    init(sourceTokenStream, targetTokenStream);
+  BasicSuffixArray(TokenRange sourceTokenStream, TokenRange targetTokenStream,
+                   Construction algorithm = AutomaticConstruction) {
+    init(sourceTokenStream, targetTokenStream, algorithm);
+  }
+
+  /// Create a generalized SuffixArray for any number of token streams.
+  explicit BasicSuffixArray(const std::vector<TokenRange> &tokenStreams,
+                            Construction algorithm = AutomaticConstruction) {
+    init(tokenStreams, algorithm);
+  }
+
+  /// Create a SuffixArray of text, whose index points must be non-negative.
+  /// Sentinels, if any, are up to the caller.
+  explicit BasicSuffixArray(std::vector<Index> text,
+                            Construction algorithm = AutomaticConstruction) {
+    build(text, algorithm);
   }
 
   /// Initialize this SuffixArray with the specified token streams.
-  void init(const std::vector<Token> sourceTokenStream,
-            const std::vector<Token> targetTokenStream);
+  void init(TokenRange sourceTokenStream, TokenRange targetTokenStream,
+            Construction algorithm = AutomaticConstruction);
 
-  bool operator==(const SuffixArray &rhs) const { 
+  /// Initialize this SuffixArray with the concatenation of tokenStreams. 
+  /// Stream k is followed by the sentinel k, so every sentinel is distinct
+  /// and no common prefix reaches from one stream into the next. The token
+  /// ids must therefore all be at least tokenStreams.size().
+  void init(const std::vector<TokenRange> &tokenStreams,
+            Construction algorithm = AutomaticConstruction);
+
+  bool operator==(const BasicSuffixArray &rhs) const { 
     return orderedIdxPoints == rhs.orderedIdxPoints; 
   }
 
-  bool operator!=(const SuffixArray &rhs) const { return !(*this == rhs); }
-  const int idxAt(const int x) const { return orderedIdxPoints[x]; }
-  const int lcpAt(const int x) const { return lcps[x]; }
+  bool operator!=(const BasicSuffixArray &rhs) const { return !(*this == rhs); }
+  const Index idxAt(const Index x) const { return orderedIdxPoints[x]; }
+  const Index lcpAt(const Index x) const { return lcps[x]; }
+
+  /// fits - Returns true if a suffix array of this index type can hold
+  /// streams token streams with a total of tokens tokens.
+  static bool fits(size_t tokens, size_t streams = 2) {
+    // A sentinel per stream and the three elements of DC3 padding.
+    return tokens + streams <= (size_t)std::numeric_limits<Index>::max() - 3;
+  }
 
   /// getOrderedIndexPoints - Return the list of sorted index points.
-  std::vector<int> orderedIndexPoints() const {
+  const std::vector<Index> &orderedIndexPoints() const {
     return orderedIdxPoints;
   }
 
   /// getLCPArray - Return the list of longest common prefixes.
-  std::vector<int> LCPs() const {
+  const std::vector<Index> &LCPs() const {
     return lcps;
   }
 
-  /// getOrderedLCPArray - Return the sorted list of longest common prefixes.
-  std::vector<int> orderedLCPs() const {
-    return orderedlcps;
-  }
+  /// sortSuffixes - Returns the suffixes of indexPoints in lexicographic 
+  /// order, sorted with the specified algorithm. Every index point must be 
+  /// non-negative. The parallel construction uses the given number of 
+  /// threads, or one per hardware thread when threads is 0. DC3 works in 
+  /// the given workspace, or in one kept per calling thread when it is null.
+  static std::vector<Index> sortSuffixes(std::vector<Index> indexPoints,
+                                       Construction algorithm,
+                                       unsigned threads = 0,
+                                       Workspace *workspace = 0);
 
 private:
+  /// build - Sort the suffixes of text and compute their LCPs. The text is
+  /// consumed.
+  void build(std::vector<Index> &text, Construction algorithm);
+
+  /// sortText - Like sortSuffixes, but sorts text itself instead of a copy.
+  /// On return text holds the remapped alphabet, in which index points are
+  /// equal exactly where they were equal before.
+  static std::vector<Index> sortText(std::vector<Index> &text,
+                                   Construction algorithm,
+                                   unsigned threads, Workspace *workspace);
+
   /// buildBuilds the siffix array with the DC3 (Difference Cover 3) divide and 
   /// conquer algorithm. We closely follow the exposition of the paper by 
   /// Karkkainen-Sanders-Burkhardt that originally proposed this algorithm
@@ -74,40 +167,101 @@ private:
   /// Journal of the ACM Volume 53 Issue 6, November 2006. Implementation 
   /// provided by the authors at 
   ///       http://www.mpi-inf.mpg.de/~sanders/programs/suffix/
-  void DC3(int* s, int* SA, int n, int K);
+  static void DC3(const Index* s, Index* SA, Index n, Index K, 
+                  unsigned threads, Index *work, Workspace &workspace);
+
+  /// Returns the number of ints of workspace DC3 needs for n index points,
+  /// including every level of recursion below it.
+  static size_t DC3WorkspaceSize(Index n);
 
 
   /// DC3 - Sorts the index points according to their corresponding suffixes
   ///       with the DC3 (Difference Cover 3) divide and conquer algorithm. 
   ///       We closely follow the exposition of the paper by Karkkainen-
   ///       Sanders-Burkhardt that originally proposed this algorithm in their 
-  ///       paper "Linear Work Suffix Array Construction".
-  std::vector<int> DC3(std::vector<int> idxPoints);
+  ///       paper "Linear Work Suffix Array Construction". With more than one
+  ///       thread, the radix passes, the naming of triples and the final 
+  ///       merge of each recursion level are split between the threads.
+  static std::vector<Index> DC3(const std::vector<Index> &idxPoints, 
+                              unsigned threads, Workspace &workspace);
+
+  /// SAIS - Sorts the index points according to their corresponding suffixes
+  ///        by induced sorting, as described by Nong, Zhang and Chan in "Two 
+  ///        Efficient Algorithms for Linear Time Suffix Array Construction", 
+  ///        IEEE Transactions on Computers 60(10), 2011. The end of the text 
+  ///        is treated as a virtual sentinel smaller than every index point, 
+  ///        so no padding is required.
+  ///        The index points must already be remapped to 0..K-1; texts 
+  ///        with K <= NarrowAlphabet are sorted as 16-bit characters.
+  static std::vector<Index> SAIS(const std::vector<Index> &idxPoints, Index K);
+
+  /// Builds the suffix array SA of s[0..n-1] over the alphabet 0..K-1 with
+  /// the SA-IS algorithm. The reduced problem is stored inside SA itself.
+  template <typename Char>
+  static void SAIS(const Char *s, Index *SA, Index n, Index K);
+
+  /// Induce the order of the L-type and then the S-type suffixes from the 
+  /// LMS suffixes already placed at the ends of their buckets in SA.
+  template <typename Char>
+  static void induceSAIS(const Char *s, Index *SA, Index n, 
+                         const std::vector<bool> &stype,
+                         const std::vector<Index> &bucketSizes);
+
+  /// remapAlphabet - Replace every index point by first plus its rank among
+  /// the distinct index points. Token hash ids are handed out globally, so 
+  /// the streams of one suffix array rarely use more than a fraction of 
+  /// them; the dense alphabet keeps the bucket and radix counters small. 
+  /// Order is preserved, and with it the order of the suffixes. Returns one 
+  /// past the largest new index point.
+  static Index remapAlphabet(std::vector<Index> &idxPoints, Index first);
+
+  /// Alphabets of at most this many symbols fit in 16-bit characters.
+  static const int NarrowAlphabet = 1 << 16;
+
+  /// Returns true if position i starts a leftmost S-type suffix.
+  static inline bool isLMS(const std::vector<bool> &stype, Index i) {
+    return i > 0 && stype[i] && !stype[i - 1];
+  }
 
   /// Computes the length of the longest common prefix between neighboring 
-  /// entries of the intermediate array. We use the algorithm of Kasai et al. 
-  /// for the linear time computation. The algorithm used comes from the paper 
-  /// "Linear-Time Longest-Common-Prefix Computation in Suffix Arrays and Its 
-  /// Applications" by: Toru Kasai, Gunho Lee, Hiroki Arimura, Setsuo Arikawa, 
-  /// and Kunsoo Park in Combinatorial Pattern Matching (2001), pp. 181-192.
-  std::vector<int> computeLCPs(const std::vector<int> &idxPoints, 
-                               const std::vector<int> &orderedIdxPoints);
-
-  /// orderLCPArray - Sort lcps in order of decreasing length.
-  std::vector<int> orderLCPs(const std::vector<int> &LCPs);
+  /// entries of the intermediate array. We use the Phi algorithm, which 
+  /// computes the permuted LCP array in text order first, from the paper 
+  /// "Permuted Longest-Common-Prefix Array" by Juha Karkkainen, Giovanni 
+  /// Manzini and Simon J. Puglisi in Combinatorial Pattern Matching (2009).
+  /// Unlike the rank array of Kasai et al. it walks the text in order, and 
+  /// the text's storage is reused for the result, so idxPoints is consumed.
+  std::vector<Index> computeLCPs(std::vector<Index> &idxPoints, 
+                               const std::vector<Index> &orderedIdxPoints);
   
-  /// Stably sort src[0..n-1] to dst[0..n-1] with keys in 0..K from r.
-  void radixPass(int *a, int *b, int *r, int n, int K);
+  /// Stably sort src[0..n-1] to dst[0..n-1] with keys in 0..K from r. Large
+  /// keys are sorted one digit at a time so that each thread only needs 
+  /// RadixCounters counters. Multi-digit passes use 3n ints of the 
+  /// workspace's radix scratch.
+  static void radixPass(Index *a, Index *b, const Index *r, Index n, Index K, 
+                        unsigned threads, Workspace &workspace);
+
+  /// Keys of up to this many bits are sorted in a single pass.
+  static const int RadixDigitBits = 11;
+
+  /// Number of counters each thread needs for one radix pass.
+  static const int RadixCounters = 1 << RadixDigitBits;
 
   /// Lexicographic order for pairs.
-  static inline bool leq(int a1, int a2, int b1, int b2) {
+  static inline bool leq(Index a1, Index a2, Index b1, Index b2) {
     return(a1 < b1 || a1 == b1 && a2 <= b2); 
   }
 
   /// Lexicographic order for triples.
-  static inline bool leq(int a1, int a2, int a3, int b1, int b2, int b3) {
+  static inline bool leq(Index a1, Index a2, Index a3, 
+                         Index b1, Index b2, Index b3) {
     return(a1 < b1 || a1 == b1 && leq(a2,a3, b2,b3)); 
   }
 };
 
+/// SuffixArray - The default, 32-bit suffix array.
+typedef BasicSuffixArray<int> SuffixArray;
+
+/// SuffixArray64 - A suffix array for inputs of more than 2^31 tokens.
+typedef BasicSuffixArray<int64_t> SuffixArray64;
+
 #endif // SUFFIXARRAY_H
@@ -0,0 +1,98 @@
+//===--- TempFile.cpp - Scratch file for external algorithms --------------===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements the TempFile interface.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TempFile.h"
+
+#include <cstdlib>
+#include <unistd.h>
+
+TempFile::TempFile(const std::string &directory, Statistics &s)
+  : fd(-1), length(0), failed(false), stats(&s) {
+  std::string path = directory + "/ndiffXXXXXX";
+  std::vector<char> name(path.begin(), path.end());
+  name.push_back('\0');
+  fd = mkstemp(&name[0]);
+  if (fd >= 0) {
+    unlink(&name[0]);
+    ++stats->files;
+  }
+  buffer.reserve(BufferSize);
+}
+
+TempFile::~TempFile() {
+  if (fd >= 0)
+    close(fd);
+}
+
+void TempFile::appendBytes(const void *data, size_t n) {
+  if (buffer.size() + n > buffer.capacity())
+    flush();
+  if (n > buffer.capacity()) {
+    writeBytes(data, n, length);
+  } else {
+    const char *bytes = static_cast<const char *>(data);
+    buffer.insert(buffer.end(), bytes, bytes + n);
+  }
+  length += n;
+}
+
+bool TempFile::flush() {
+  if (!buffer.empty()) {
+    writeBytes(&buffer[0], buffer.size(), length - buffer.size());
+    buffer.clear();
+  }
+  return isOpen();
+}
+
+void TempFile::writeBytes(const void *data, size_t n, uint64_t offset) {
+  size_t done = 0;
+  while (fd >= 0 && done < n) {
+    const ssize_t w = pwrite(fd, static_cast<const char *>(data) + done, 
+                             n - done, offset + done);
+    if (w <= 0)
+      break;
+    done += w;
+  }
+  if (done < n)
+    failed = true;
+  stats->bytesWritten += done;
+}
+
+void TempFile::clear() {
+  buffer.clear();
+  length = 0;
+  if (fd >= 0 && ftruncate(fd, 0) != 0)
+    failed = true;
+}
+
+void TempFile::swap(TempFile &other) {
+  std::swap(fd, other.fd);
+  std::swap(length, other.length);
+  buffer.swap(other.buffer);
+  std::swap(failed, other.failed);
+  std::swap(stats, other.stats);
+}
+
+size_t TempFile::readBytes(void *data, size_t n, uint64_t offset) const {
+  if (fd < 0 || offset >= length)
+    return 0;
+  if (n > length - offset)
+    n = length - offset;
+  size_t done = 0;
+  while (done < n) {
+    const ssize_t r = pread(fd, static_cast<char *>(data) + done, n - done, 
+                            offset + done);
+    if (r <= 0)
+      break;
+    done += r;
+  }
+  stats->bytesRead += done;
+  return done;
+}
@@ -0,0 +1,151 @@
+//===--- TempFile.h - Scratch file for external algorithms ----*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines the TempFile interface.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef TEMPFILE_H
+#define TEMPFILE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// TempFile - A scratch file of fixed size records for algorithms that keep 
+/// their data on disk. The file is unlinked as soon as it is created, so it
+/// disappears with the process however that ends. It is written by 
+/// appending and read through any number of independent, buffered Readers.
+class TempFile {
+public:
+  /// Statistics - The I/O volume of a group of temporary files.
+  struct Statistics {
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    uint64_t files;
+    Statistics() : bytesRead(0), bytesWritten(0), files(0) {}
+  };
+
+  /// BufferSize - The default size of read and write buffers, in bytes.
+  static const size_t BufferSize = 1 << 20;
+
+private:
+  /// The file descriptor, or -1 if the file could not be created.
+  int fd;
+
+  /// Number of bytes in the file, including those still buffered.
+  uint64_t length;
+
+  /// Appended bytes not yet written.
+  std::vector<char> buffer;
+
+  /// Set once a write has failed.
+  bool failed;
+
+  /// Where the I/O of this file is counted.
+  Statistics *stats;
+
+  TempFile(const TempFile &);            // Do not implement.
+  TempFile &operator=(const TempFile &); // Do not implement.
+public:
+  /// TempFile constructor - Create an empty file in directory, counting its
+  /// I/O in stats.
+  TempFile(const std::string &directory, Statistics &stats);
+  ~TempFile();
+
+  /// isOpen - Returns true if the file was created and no write has failed.
+  bool isOpen() const { return fd >= 0 && !failed; }
+
+  /// size - Returns the number of bytes in the file.
+  uint64_t size() const { return length; }
+
+  /// append - Append n records to the end of the file.
+  template <typename T>
+  void append(const T *records, size_t n) {
+    appendBytes(records, n * sizeof(T));
+  }
+
+  /// append - Append one record to the end of the file.
+  template <typename T>
+  void append(const T &record) { appendBytes(&record, sizeof(T)); }
+
+  /// overwrite - Replace the n records starting at record first, which must
+  /// all have been flushed already.
+  template <typename T>
+  void overwrite(const T *records, size_t n, uint64_t first) {
+    writeBytes(records, n * sizeof(T), first * sizeof(T));
+  }
+
+  /// flush - Write out everything appended so far. Returns false if any 
+  /// write has failed.
+  bool flush();
+
+  /// clear - Truncate the file to zero length.
+  void clear();
+
+  /// swap - Exchange the contents of two files.
+  void swap(TempFile &other);
+
+  /// Reader - Reads count records of type T sequentially, starting at 
+  /// record first, or up to the end of the file if count is not given. 
+  /// Readers of one file are independent of each other, but the file must 
+  /// be flushed before they are created.
+  template <typename T>
+  class Reader {
+    const TempFile &file;
+    uint64_t offset, end;
+    size_t capacity;
+    std::vector<T> records;
+    size_t pos, count;
+  public:
+    explicit Reader(const TempFile &f, uint64_t first = 0, 
+                    uint64_t n = UINT64_MAX, 
+                    size_t bufferSize = BufferSize)
+      : file(f), offset(first * sizeof(T)), 
+        end(n < (UINT64_MAX - offset) / sizeof(T) ? 
+              offset + n * sizeof(T) : UINT64_MAX),
+        capacity(std::max<size_t>(1, bufferSize / sizeof(T))), 
+        pos(0), count(0) {}
+
+    /// next - Read the next record into record. Returns false at the end of
+    /// the file.
+    bool next(T &record) {
+      if (pos == count) {
+        if (offset >= end)
+          return false;
+        // Allocate the buffer on first use only; Readers get copied around.
+        if (records.empty())
+          records.resize(capacity);
+        const uint64_t want = std::min<uint64_t>(capacity * sizeof(T), 
+                                                 end - offset);
+        count = file.readBytes(&records[0], want, offset) / sizeof(T);
+        pos = 0;
+        if (count == 0) {
+          end = offset;
+          return false;
+        }
+        offset += count * sizeof(T);
+      }
+      record = records[pos++];
+      return true;
+    }
+  };
+
+private:
+  /// appendBytes - Buffer n bytes for writing at the end of the file.
+  void appendBytes(const void *data, size_t n);
+
+  /// writeBytes - Write n bytes at offset, bypassing the buffer.
+  void writeBytes(const void *data, size_t n, uint64_t offset);
+
+  /// readBytes - Read up to n bytes at offset into data. Returns the number
+  /// of bytes read.
+  size_t readBytes(void *data, size_t n, uint64_t offset) const;
+};
+
+#endif // TEMPFILE_H
@@ -11,13 +11,14 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <stdint.h>
 #include <string>
 
 /// Token - This structure provides full information about a lexed token.
 class Token {
   std::string charData;
+  int64_t offset;
   int hashValue;
-  int offset;
   int line, column;
 
   /// flags - Bits we track about this token, members of the TokenFlags enum.
@@ -32,8 +33,8 @@ public:
   };
 
   /// Token constructor - Create a new Token object.
-  Token(std::string chardata, int hval, int off, int lin, int col)
-    : charData(chardata), hashValue(hval), offset(off), line(lin), column(col) {
+  Token(std::string chardata, int hval, int64_t off, int lin, int col)
+    : charData(chardata), offset(off), hashValue(hval), line(lin), column(col) {
       clearFlag(startOfLine);
       clearFlag(leadingSpace);
       clearFlag(whitespace);
@@ -47,7 +48,7 @@ public:
   bool operator>=(const Token &rhs) const { return rhs <= *this; }
 
   /// getCharacterData - Return the character data identified by this token.
-  const std::string getCharData() const { return charData; }
+  const std::string &getCharData() const { return charData; }
 
   /// getColumn - Return the presumed column number of this location.  This can
   /// not be affected by #line, but is packaged here for convenience.
@@ -63,7 +64,7 @@ public:
   /// lexedOffset - Return a value for mapping virtual token indexes (not 
   ///                counting discarded tokens) to real ones (counting those 
   ///                tokens).
-  int lexedOffset() const { return offset; }
+  int64_t lexedOffset() const { return offset; }
 
   /// setFlag - Set the specified flag.
   void setFlag(TokenFlags flag) {
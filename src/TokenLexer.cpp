@@ -14,34 +14,37 @@
 
 std::vector<Token> TokenLexer::tokenize(const std::string &filename) {
   std::vector<Token> tokenStream;
-  if (!(yyin = fopen(filename.c_str(), "r")))
+  FILE *file = fopen(filename.c_str(), "r");
+  if (!file)
     return tokenStream;
 
-  // Initilize location data.
+  // Point the scanner at the file and initilize location data.
+  yyrestart(file, scanner);
+  yyset_lineno(1, scanner);
   int col = 0, line = 1; 
-  yylineno = 1;
 
-  for (int sym; sym = yylex();) {
+  for (int sym; sym = yylex(scanner);) {
+    const char *text = yyget_text(scanner);
 
     // Assign a hash value if not whitespace.
     int hashVal = -1;
     if (sym != TOK_WS) {
       std::map<std::string, int>::iterator 
-        i(tokenHashMap.find(yytext)), e(tokenHashMap.end());
+        i(tokenHashMap.find(text)), e(tokenHashMap.end());
       if (i == e) {
         hashVal = nextHashValue++;
-        tokenHashMap.insert(std::pair<std::string, int>(yytext, hashVal));          
+        tokenHashMap.insert(std::pair<std::string, int>(text, hashVal));          
       } else
         hashVal = (*i).second;        
     }
 
     // Update location data.
-    const int offset = tokenStream.size();
-    if (line != yylineno) { col = 1; ++line; } 
+    const int64_t offset = tokenStream.size();
+    if (line != yyget_lineno(scanner)) { col = 1; ++line; } 
     else { ++col; }    
 
     // Create a Token object with the data for this lexed token.
-    Token tok(yytext, hashVal, offset, line, col);
+    Token tok(text, hashVal, offset, line, col);
 
     // Set appropriate flags.
     if (!tokenStream.empty() && tokenStream.back().isWhitespace()) 
@@ -52,6 +55,55 @@ std::vector<Token> TokenLexer::tokenize(const std::string &filename) {
     // Add the token 
     tokenStream.push_back(tok);    
   }
-  fclose(yyin);	
+  fclose(file);	
   return tokenStream;
 }
+
+bool TokenLexer::tokenStreamsDiffer(const std::string &sourcePath, 
+                                    const std::string &targetPath) {
+  FILE *files[2] = { fopen(sourcePath.c_str(), "r"), 
+                     fopen(targetPath.c_str(), "r") };
+
+  // Each file gets its own flex buffer so that we can alternate between them
+  // one token at a time. A file that failed to open has no buffer at all.
+  YY_BUFFER_STATE buffers[2] = { 0, 0 };
+  for (int i = 0; i < 2; ++i)
+    if (files[i])
+      buffers[i] = yy_create_buffer(files[i], 16384, scanner);
+
+  bool differ = false;
+  for (std::string text[2];;) {
+    bool more[2];
+    for (int i = 0; i < 2; ++i) {
+      more[i] = false;
+      if (buffers[i]) {
+        yy_switch_to_buffer(buffers[i], scanner);
+        more[i] = nextSignificantToken(text[i]);
+      }
+    }
+    if (more[0] != more[1] || (more[0] && text[0] != text[1])) {
+      differ = true;
+      break;
+    }
+    if (!more[0])
+      break;
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    if (buffers[i])
+      yy_delete_buffer(buffers[i], scanner);
+    if (files[i])
+      fclose(files[i]);
+  }
+  return differ;
+}
+
+bool TokenLexer::nextSignificantToken(std::string &text) {
+  for (int sym; (sym = yylex(scanner));) {
+    if (sym != TOK_WS) {
+      text.assign(yyget_text(scanner), yyget_leng(scanner));
+      return true;
+    }
+  }
+  return false;
+}
@@ -17,33 +17,73 @@
 
 class Token;
 
-/* Flex variables. */
+/* Flex scanner interface. The scanner is reentrant: all of its state is held
+   by a yyscan_t, which every function takes. */
 #define TOK_WS 255
-extern int yylineno;
-extern int yyleng;
-extern const char *yytext;
-extern const char *yyfilename;
-extern int yylex();
-extern FILE *yyin;
+typedef void *yyscan_t;
+extern int yylex_init(yyscan_t *scanner);
+extern int yylex_destroy(yyscan_t scanner);
+extern int yylex(yyscan_t scanner);
+extern char *yyget_text(yyscan_t scanner);
+extern int yyget_leng(yyscan_t scanner);
+extern int yyget_lineno(yyscan_t scanner);
+extern void yyset_lineno(int line_number, yyscan_t scanner);
+extern void yyrestart(FILE *input_file, yyscan_t scanner);
+
+/* Flex buffer management, used to interleave scanning of two files. */
+struct yy_buffer_state;
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+extern YY_BUFFER_STATE yy_create_buffer(FILE *file, int size, 
+                                        yyscan_t scanner);
+extern void yy_switch_to_buffer(YY_BUFFER_STATE new_buffer, yyscan_t scanner);
+extern void yy_delete_buffer(YY_BUFFER_STATE b, yyscan_t scanner);
 
 /// TokenLexer - This implements a lexer that returns tokens from a character
-///              stream.
+///              stream. Every TokenLexer has a scanner of its own, so
+///              TokenLexers on different threads share no state.
 class TokenLexer {  
   std::map<std::string, int> tokenHashMap;
   int nextHashValue;
+  yyscan_t scanner;
+
+  TokenLexer(const TokenLexer &);            // DO NOT IMPLEMENT
+  TokenLexer &operator=(const TokenLexer &); // DO NOT IMPLEMENT
 public:
   /// TokenLexer constructor - Create a new TokenLexer object with reserving
   ///                          the default number of sentinel characters.
-  TokenLexer() : nextHashValue(2) {}
+  TokenLexer() : nextHashValue(2) { yylex_init(&scanner); }
 
   /// TokenLexer constructor - Create a new TokenLexer object with reserving
   ///                          the specified number of sentinel characters.
-  explicit TokenLexer(int sentinels) : nextHashValue(sentinels) {}
+  explicit TokenLexer(int sentinels) : nextHashValue(sentinels) { 
+    yylex_init(&scanner); 
+  }
+
+  ~TokenLexer() { yylex_destroy(scanner); }
 
   /// tokenize - Convert the stream of characters corresponding to the filename
   ///            into a stream of tokens. Reduce the tokens to a string of hashes 
   ///            where each Unicode character represents one token.
   std::vector<Token> tokenize(const std::string &filename);
+
+  /// dictionary - Returns the hash value assigned to the text of every 
+  ///              non-whitespace token lexed so far.
+  const std::map<std::string, int> &dictionary() const { 
+    return tokenHashMap; 
+  }
+
+  /// tokenStreamsDiffer - Lex both files in lock step and return true as soon
+  ///                      as their non-whitespace tokens differ. Neither file
+  ///                      is lexed past the first difference. A file that 
+  ///                      cannot be opened is treated as empty, as tokenize 
+  ///                      does.
+  bool tokenStreamsDiffer(const std::string &sourcePath, 
+                          const std::string &targetPath);
+private:
+  /// nextSignificantToken - Scan the current flex buffer up to the next token
+  ///                        that is not whitespace and store its text. Returns
+  ///                        false at the end of the buffer.
+  bool nextSignificantToken(std::string &text);
 };
 
 #endif // TOKENLEXER_H
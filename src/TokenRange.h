@@ -0,0 +1,173 @@
+//===--- TokenRange.h - A view of consecutive tokens ----------*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines the TokenRange interface.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef TOKENRANGE_H
+#define TOKENRANGE_H
+
+#include "Token.h"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+/// TokenRange - A constant view of consecutive tokens of a token stream, by
+/// a pointer to the first and their number. Ranges are passed by value and
+/// sliced without copying any tokens, and convert implicitly from a whole
+/// stream. A range may also view the ids of its tokens, laid out one after
+/// the other, for scans that only compare ids. A range is only valid as long
+/// as the stream it views is left alone.
+///
+/// A range may instead view tokens scattered over a stream, by their
+/// positions in it: the tokens of a lexed stream that are not whitespace
+/// are viewed this way, in place, rather than copied out of it.
+class TokenRange {
+  const Token *data;
+  const int64_t *positionData;
+  const int *idData;
+  size_t length;
+  size_t streamLength;
+public:
+  /// const_iterator - Walks the tokens of a range, consecutive or by their
+  /// positions.
+  class const_iterator {
+    const Token *data;
+    const int64_t *position;
+  public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef Token value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const Token *pointer;
+    typedef const Token &reference;
+
+    explicit const_iterator(const Token *d = 0, const int64_t *p = 0)
+      : data(d), position(p) {}
+
+    /// base, positions - The token the iterator is at, or the stream and its
+    /// position in the positions the range views it by.
+    const Token *base() const { return data; }
+    const int64_t *positions() const { return position; }
+
+    const Token &operator*() const {
+      return position ? data[*position] : *data;
+    }
+    const Token *operator->() const { return &**this; }
+    const Token &operator[](ptrdiff_t n) const { return *(*this + n); }
+
+    const_iterator &operator+=(ptrdiff_t n) {
+      if (position)
+        position += n;
+      else
+        data += n;
+      return *this;
+    }
+    const_iterator &operator-=(ptrdiff_t n) { return *this += -n; }
+    const_iterator &operator++() { return *this += 1; }
+    const_iterator &operator--() { return *this += -1; }
+    const_iterator operator++(int) { const_iterator i(*this); ++*this; return i; }
+    const_iterator operator--(int) { const_iterator i(*this); --*this; return i; }
+    const_iterator operator+(ptrdiff_t n) const {
+      const_iterator i(*this);
+      return i += n;
+    }
+    const_iterator operator-(ptrdiff_t n) const {
+      const_iterator i(*this);
+      return i -= n;
+    }
+    ptrdiff_t operator-(const const_iterator &rhs) const {
+      return position ? position - rhs.position : data - rhs.data;
+    }
+
+    bool operator==(const const_iterator &rhs) const {
+      return data == rhs.data && position == rhs.position;
+    }
+    bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+    bool operator<(const const_iterator &rhs) const { return *this - rhs < 0; }
+    bool operator>(const const_iterator &rhs) const { return rhs < *this; }
+    bool operator<=(const const_iterator &rhs) const { return !(rhs < *this); }
+    bool operator>=(const const_iterator &rhs) const { return !(*this < rhs); }
+  };
+  typedef const_iterator iterator;
+
+  /// TokenRange constructor - Create an empty range.
+  TokenRange()
+    : data(0), positionData(0), idData(0), length(0), streamLength(0) {}
+
+  /// TokenRange constructor - View all of tokenStream.
+  TokenRange(const std::vector<Token> &tokenStream)
+    : data(tokenStream.empty() ? 0 : &tokenStream[0]), positionData(0),
+      idData(0), length(tokenStream.size()),
+      streamLength(tokenStream.size()) {}
+
+  /// TokenRange constructor - View the tokens of tokenStream at positions,
+  /// along with ids, which holds the id of each of them unless it is empty.
+  TokenRange(const std::vector<Token> &tokenStream,
+             const std::vector<int64_t> &positions,
+             const std::vector<int> &ids)
+    : data(tokenStream.empty() ? 0 : &tokenStream[0]),
+      positionData(positions.empty() ? 0 : &positions[0]),
+      idData(ids.empty() ? 0 : &ids[0]), length(positions.size()),
+      streamLength(positions.size()) {}
+
+  /// TokenRange constructor - View the len tokens from first on.
+  TokenRange(const Token *first, size_t len)
+    : data(first), positionData(0), idData(0), length(len),
+      streamLength(len) {}
+
+  /// TokenRange constructor - View the len tokens from first on, whose ids
+  /// are the len from firstId on.
+  TokenRange(const Token *first, const int *firstId, size_t len)
+    : data(first), positionData(0), idData(firstId), length(len),
+      streamLength(len) {}
+
+  /// TokenRange constructor - View the len tokens from first on.
+  TokenRange(const_iterator first, size_t len)
+    : data(first.base()), positionData(first.positions()), idData(0),
+      length(len), streamLength(len) {}
+
+  const_iterator begin() const { return const_iterator(data, positionData); }
+  const_iterator end() const { return begin() + length; }
+
+  /// streamEnd - Returns the end of the stream the range was sliced from.
+  /// The tokens between end() and streamEnd() follow the range in it.
+  const_iterator streamEnd() const { return begin() + streamLength; }
+
+  size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+
+  const Token &operator[](size_t i) const {
+    return positionData ? data[positionData[i]] : data[i];
+  }
+  const Token &front() const { return (*this)[0]; }
+  const Token &back() const { return (*this)[length - 1]; }
+
+  /// ids - Returns the ids of the tokens, or null if they are not at hand.
+  const int *ids() const { return idData; }
+
+  /// slice - Returns the len tokens from position pos on.
+  TokenRange slice(size_t pos, size_t len) const {
+    TokenRange range(begin() + pos, len);
+    range.idData = idData ? idData + pos : 0;
+    range.streamLength = streamLength - pos;
+    return range;
+  }
+
+  /// slice - Returns the tokens from position pos to the end.
+  TokenRange slice(size_t pos) const { return slice(pos, length - pos); }
+
+  /// equals - Returns true if rhs holds the same tokens.
+  bool equals(TokenRange rhs) const {
+    return length == rhs.length && std::equal(begin(), end(), rhs.begin());
+  }
+
+  /// vec - Returns a copy of the tokens.
+  std::vector<Token> vec() const { return std::vector<Token>(begin(), end()); }
+};
+
+#endif // TOKENRANGE_H
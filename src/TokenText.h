@@ -0,0 +1,52 @@
+//===--- TokenText.h - Two token streams as one text ----------*- C++ -*-===//
+//
+//                     The NDiff File Comparison Utility
+//
+//===--------------------------------------------------------------------===//
+//
+// This file defines the TokenText interface.
+//
+//===----------------------------------------------------------------------===
+
+#ifndef TOKENTEXT_H
+#define TOKENTEXT_H
+
+#include "Token.h"
+#include "TokenRange.h"
+
+/// TokenText - The text a BasicSuffixArray builds of two token streams: the
+/// source, the sentinel 0, the target and the sentinel 1. Token ids are at 
+/// least 2, so the sentinels match nothing but themselves.
+template <typename Index>
+class TokenText {
+  const TokenRange source, target;
+public:
+  /// Where the source's sentinel and the target start, and the text's length.
+  const Index sourceSize, targetStart, size;
+
+  TokenText(TokenRange sourceTokenStream, TokenRange targetTokenStream)
+    : source(sourceTokenStream), target(targetTokenStream), 
+      sourceSize(sourceTokenStream.size()), targetStart(sourceSize + 1), 
+      size(targetStart + targetTokenStream.size() + 1) {}
+
+  /// operator[] - Returns the id at position p.
+  Index operator[](Index p) const {
+    if (p < sourceSize)
+      return source[p].getHashValue();
+    if (p == sourceSize)
+      return 0;
+    if (p + 1 < size)
+      return target[p - targetStart].getHashValue();
+    return 1;
+  }
+
+  /// isSentinel - Returns true if position p holds a sentinel.
+  bool isSentinel(Index p) const { return p == sourceSize || p + 1 == size; }
+
+  /// token - Returns the token at position p, which must not be a sentinel.
+  const Token &token(Index p) const {
+    return (p < sourceSize) ? source[p] : target[p - targetStart];
+  }
+};
+
+#endif // TOKENTEXT_H
@@ -0,0 +1,14 @@
+static int clamp(int value, int low, int high) {
+  if (value < low)
+    return low;
+  if (value > high)
+    return high;
+  return value;
+}
+
+static int average(const int *values, int n) {
+  int total = 0;
+  for (int i = 0; i < n; ++i)
+    total += values[i];
+  return n ? total / n : 0;
+}
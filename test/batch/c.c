@@ -0,0 +1,14 @@
+static long average(const int *values, int n) {
+  long total = 0;
+  for (int i = 0; i < n; ++i)
+    total += values[i];
+  return n ? total / n : 0;
+}
+
+static int clamp(int value, int low, int high) {
+  if (value < low)
+    return low;
+  if (value > high)
+    return high;
+  return value;
+}
@@ -0,0 +1,8 @@
+int twice(int x) { return x + x; }
+
+long total(int *v, int n) {
+  int total = 0;
+  for (int i = 0; i < n; ++i)
+    total += v[i];
+  return total;
+}
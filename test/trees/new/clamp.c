@@ -0,0 +1,10 @@
+static int clamp(int value, int low, int high) {
+  return value < low ? low : value > high ? high : value;
+}
+
+static int average(const int *values, int n) {
+  int total = 0;
+  for (int i = 0; i < n; ++i)
+    total += values[i];
+  return n ? total / n : 0;
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+struct list {
+  long value;
+  struct list *next;
+};
+
+static struct list *push(struct list *head, long value) {
+  struct list *node = malloc(sizeof(*node));
+  if (!node) {
+    perror("push");
+    exit(1);
+  }
+  node->value = value;
+  node->next = head;
+  return node;
+}
+
+static int count(const struct list *head) {
+  int n = 0;
+  for (; head; head = head->next)
+    ++n;
+  return n;
+}
+
+static long sum(const struct list *head) {
+  long total = 0;
+  for (; head; head = head->next)
+    total += head->value;
+  return total;
+}
+
+static void release(struct list *head) {
+  while (head) {
+    struct list *next = head->next;
+    free(head);
+    head = next;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  struct list *head = 0;
+  int i;
+  for (i = 1; i < argc; ++i)
+    head = push(head, atol(argv[i]));
+  printf("%d values, sum %ld\n", count(head), sum(head));
+  release(head);
+  return 0;
+}
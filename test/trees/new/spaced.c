@@ -0,0 +1,4 @@
+int cube(int x)
+{
+    return x*x*x;
+}
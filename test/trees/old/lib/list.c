@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+struct list {
+  int value;
+  struct list *next;
+};
+
+static struct list *push(struct list *head, int value) {
+  struct list *node = malloc(sizeof(*node));
+  if (!node)
+    return head;
+  node->value = value;
+  node->next = head;
+  return node;
+}
+
+static int sum(const struct list *head) {
+  int total = 0;
+  for (; head; head = head->next)
+    total += head->value;
+  return total;
+}
+
+static int count(const struct list *head) {
+  int n = 0;
+  for (; head; head = head->next)
+    ++n;
+  return n;
+}
+
+static void release(struct list *head) {
+  while (head) {
+    struct list *next = head->next;
+    free(head);
+    head = next;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  struct list *head = 0;
+  int i;
+  for (i = 1; i < argc; ++i)
+    head = push(head, atoi(argv[i]));
+  printf("%d values, sum %d\n", count(head), sum(head));
+  release(head);
+  return 0;
+}
@@ -0,0 +1,3 @@
+int cube(int x) {
+  return x * x * x;
+}